@@ -19,13 +19,25 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 #include <stdio.h>
+#include "config.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_W32THREADS
+#include "compat/w32pthreads.h"
+#endif
 #include "openHevcWrapper.h"
 #include "libavcodec/avcodec.h"
 #include "libavformat/avformat.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+#include "libavutil/time.h"
 
-#define MAX_DECODERS 2
+#define MAX_DECODERS 8 ///< upper bound of the number of layers
+#define ADAPT_HOLD   8 ///< access units between two automatic layer switches
+
+/* running average of a decoding time over about 8 access units */
+#define DECODE_TIME_AVG(avg, t) ((avg) ? ((avg) * 7 + (t)) >> 3 : (t))
 #define ACTIVE_NAL
 typedef struct OpenHevcWrapperContext {
     AVCodec *codec;
@@ -33,30 +45,74 @@ typedef struct OpenHevcWrapperContext {
     AVFrame *picture;
     AVPacket avpkt;
     AVCodecParserContext *parser;
+    AVHEVCMemoryUsage mem_usage;
+    int got_picture;
+    int len;
+    int64_t decode_time; ///< average decoding time of the layer in us
+#if HAVE_THREADS
+    struct OpenHevcWrapperContexts *parent;
+    pthread_t thread;
+    unsigned au_count; ///< last access unit decoded by the layer thread
+#endif
 } OpenHevcWrapperContext;
 
 typedef struct OpenHevcWrapperContexts {
     OpenHevcWrapperContext **wraper;
     int nb_decoders;
+    int nb_open;    ///< decoders opened so far, the upper layers are opened once they are active
     int active_layer;
+    int target_layer;     ///< layer requested by the application
     int display_layer;
     int set_display;
     int set_vps;
+    OpenHevc_PictureHeaderCallback header_callback;
+    void *header_opaque;
+    OpenHevc_GetBufferCallback get_buffer;
+    OpenHevc_ReleaseBufferCallback release_buffer;
+    void *buffer_opaque;
+    int pipelined;
+    int layer_threads;    ///< the layer threads and their locks are set up
+    int64_t frame_period; ///< time budget of an access unit in us for the adaptive layers, 0 when off
+    int64_t au_time;      ///< average decoding time of an access unit in us
+    int64_t dropped_time; ///< decoding time of the upper layers when they were dropped
+    int nb_au_held;       ///< access units since the last automatic switch
+#if HAVE_THREADS
+    int nb_layer_threads;
+    unsigned au_count;
+    int nb_pending;
+    int quit;
+    pthread_mutex_t layer_mutex;
+    pthread_cond_t  layer_cond;  ///< signals a new access unit to the layer threads
+    pthread_cond_t  done_cond;   ///< signals the end of a layer to the caller
+#endif
 } OpenHevcWrapperContexts;
 
+/* a caller buffer, it can outlive the decoder */
+typedef struct OpenHevcBufferRef {
+    OpenHevc_Buffer buffer;
+    OpenHevc_ReleaseBufferCallback release_buffer;
+    void *opaque;
+} OpenHevcBufferRef;
+
 OpenHevc_Handle libOpenHevcInit(int nb_pthreads, int thread_type)
+{
+    return libOpenHevcInitLayers(nb_pthreads, thread_type, 2);
+}
+
+OpenHevc_Handle libOpenHevcInitLayers(int nb_pthreads, int thread_type, int nb_layers)
 {
     /* register all the codecs */
     int i;
     OpenHevcWrapperContexts *openHevcContexts = av_mallocz(sizeof(OpenHevcWrapperContexts));
     OpenHevcWrapperContext  *openHevcContext;
     avcodec_register_all();
-    openHevcContexts->nb_decoders   = MAX_DECODERS;
-    openHevcContexts->active_layer  = MAX_DECODERS-1;
-    openHevcContexts->display_layer = MAX_DECODERS-1;
+    openHevcContexts->nb_decoders   = av_clip(nb_layers, 1, MAX_DECODERS);
+    openHevcContexts->active_layer  = openHevcContexts->nb_decoders-1;
+    openHevcContexts->target_layer  = openHevcContexts->nb_decoders-1;
+    openHevcContexts->display_layer = openHevcContexts->nb_decoders-1;
     openHevcContexts->wraper = av_malloc(sizeof(OpenHevcWrapperContext*)*openHevcContexts->nb_decoders);
     for(i=0; i < openHevcContexts->nb_decoders; i++){
-        openHevcContext = openHevcContexts->wraper[i] = av_malloc(sizeof(OpenHevcWrapperContext));
+        openHevcContext = openHevcContexts->wraper[i] = av_mallocz(sizeof(OpenHevcWrapperContext));
         av_init_packet(&openHevcContext->avpkt);
         openHevcContext->codec = avcodec_find_decoder(AV_CODEC_ID_HEVC);
         if (!openHevcContext->codec) {
@@ -68,6 +124,8 @@ OpenHevc_Handle libOpenHevcInit(int nb_pthreads, int thread_type)
         openHevcContext->c       = avcodec_alloc_context3(openHevcContext->codec);
         openHevcContext->picture = avcodec_alloc_frame();
         openHevcContext->c->flags |= CODEC_FLAG_UNALIGNED;
+        openHevcContext->c->refcounted_frames = 1;
+        openHevcContext->c->hevc_mem_usage = &openHevcContext->mem_usage;
 
         if(openHevcContext->codec->capabilities&CODEC_CAP_TRUNCATED)
             openHevcContext->c->flags |= CODEC_FLAG_TRUNCATED; /* we do not send complete frames */
@@ -92,20 +150,166 @@ OpenHevc_Handle libOpenHevcInit(int nb_pthreads, int thread_type)
     return (OpenHevc_Handle) openHevcContexts;
 }
 
-int libOpenHevcStartDecoder(OpenHevc_Handle openHevcHandle)
+static void decode_layer(OpenHevcWrapperContext *openHevcContext)
+{
+    int64_t start = av_gettime();
+
+    av_frame_unref(openHevcContext->picture);
+    openHevcContext->got_picture = 0;
+    openHevcContext->len         = avcodec_decode_video2(openHevcContext->c, openHevcContext->picture,
+                                                         &openHevcContext->got_picture, &openHevcContext->avpkt);
+    if (openHevcContext->avpkt.size)
+        openHevcContext->decode_time = DECODE_TIME_AVG(openHevcContext->decode_time, av_gettime() - start);
+}
+
+/* Drop to the base layer when the access units take longer than their
+ * period, and go back to the requested layer once the base layer and the
+ * last known cost of the upper layers fit in 3/4 of it. The upper layers
+ * are flushed on the way back, so that they restart at their next IRAP
+ * picture, which is the next IRAP of the stream with cross-layer aligned
+ * IRAPs. */
+static void adapt_layers(OpenHevcWrapperContexts *openHevcContexts, int64_t au_time)
+{
+    int i;
+
+    openHevcContexts->au_time = DECODE_TIME_AVG(openHevcContexts->au_time, au_time);
+    if (openHevcContexts->nb_au_held < ADAPT_HOLD) {
+        openHevcContexts->nb_au_held++;
+        return;
+    }
+
+    if (openHevcContexts->active_layer > 0 &&
+        openHevcContexts->au_time > openHevcContexts->frame_period) {
+        openHevcContexts->dropped_time = 0;
+        for (i = 1; i <= openHevcContexts->active_layer; i++)
+            openHevcContexts->dropped_time += openHevcContexts->wraper[i]->decode_time;
+        openHevcContexts->active_layer = 0;
+        openHevcContexts->au_time      = openHevcContexts->wraper[0]->decode_time;
+        openHevcContexts->nb_au_held   = 0;
+    } else if (openHevcContexts->active_layer < openHevcContexts->target_layer &&
+               openHevcContexts->target_layer < openHevcContexts->nb_open &&
+               (openHevcContexts->au_time + openHevcContexts->dropped_time) * 4 < openHevcContexts->frame_period * 3) {
+        for (i = openHevcContexts->active_layer + 1; i <= openHevcContexts->target_layer; i++)
+            avcodec_flush_buffers(openHevcContexts->wraper[i]->c);
+        openHevcContexts->active_layer = openHevcContexts->target_layer;
+        openHevcContexts->au_time     += openHevcContexts->dropped_time;
+        openHevcContexts->nb_au_held   = 0;
+    }
+}
+
+#if HAVE_THREADS
+static void *layer_thread(void *arg)
+{
+    OpenHevcWrapperContext  *openHevcContext  = (OpenHevcWrapperContext *) arg;
+    OpenHevcWrapperContexts *openHevcContexts = openHevcContext->parent;
+
+    pthread_mutex_lock(&openHevcContexts->layer_mutex);
+    for (;;) {
+        while (!openHevcContexts->quit && openHevcContext->au_count == openHevcContexts->au_count)
+            pthread_cond_wait(&openHevcContexts->layer_cond, &openHevcContexts->layer_mutex);
+        if (openHevcContexts->quit)
+            break;
+        openHevcContext->au_count = openHevcContexts->au_count;
+        pthread_mutex_unlock(&openHevcContexts->layer_mutex);
+
+        decode_layer(openHevcContext);
+
+        pthread_mutex_lock(&openHevcContexts->layer_mutex);
+        if (!--openHevcContexts->nb_pending)
+            pthread_cond_signal(&openHevcContexts->done_cond);
+    }
+    pthread_mutex_unlock(&openHevcContexts->layer_mutex);
+    return NULL;
+}
+
+static void stop_layer_threads(OpenHevcWrapperContexts *openHevcContexts)
 {
-    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
-    OpenHevcWrapperContext  *openHevcContext;
     int i;
-    for(i=0; i < openHevcContexts->nb_decoders; i++) {
+
+    pthread_mutex_lock(&openHevcContexts->layer_mutex);
+    openHevcContexts->quit = 1;
+    pthread_cond_broadcast(&openHevcContexts->layer_cond);
+    pthread_mutex_unlock(&openHevcContexts->layer_mutex);
+    for (i = 1; i <= openHevcContexts->nb_layer_threads; i++)
+        pthread_join(openHevcContexts->wraper[i]->thread, NULL);
+
+    pthread_cond_destroy(&openHevcContexts->done_cond);
+    pthread_cond_destroy(&openHevcContexts->layer_cond);
+    pthread_mutex_destroy(&openHevcContexts->layer_mutex);
+    openHevcContexts->nb_layer_threads = 0;
+    openHevcContexts->layer_threads    = 0;
+}
+
+/* the base layer is decoded by the caller, each upper layer by its own thread */
+static int start_layer_threads(OpenHevcWrapperContexts *openHevcContexts)
+{
+    int i;
+
+    for (i = 0; i < openHevcContexts->nb_open; i++) {
+        if (!(openHevcContexts->wraper[i]->c->active_thread_type & FF_THREAD_FRAME)) {
+            fprintf(stderr, "Pipelined layers require frame threading, the layers are decoded one after the other \n");
+            openHevcContexts->pipelined = 0;
+            return 0;
+        }
+    }
+
+    pthread_mutex_init(&openHevcContexts->layer_mutex, NULL);
+    pthread_cond_init(&openHevcContexts->layer_cond, NULL);
+    pthread_cond_init(&openHevcContexts->done_cond, NULL);
+    openHevcContexts->quit          = 0;
+    openHevcContexts->layer_threads = 1;
+    for (i = 1; i < openHevcContexts->nb_open; i++) {
+        OpenHevcWrapperContext *openHevcContext = openHevcContexts->wraper[i];
+        openHevcContext->parent   = openHevcContexts;
+        openHevcContext->au_count = openHevcContexts->au_count;
+        if (pthread_create(&openHevcContext->thread, NULL, layer_thread, openHevcContext)) {
+            stop_layer_threads(openHevcContexts);
+            openHevcContexts->pipelined = 0;
+            return -1;
+        }
+        openHevcContexts->nb_layer_threads++;
+    }
+    return 0;
+}
+#endif
+
+/* a single layer stream only pays for the base layer decoder */
+static int open_decoders(OpenHevcWrapperContexts *openHevcContexts, int nb_layers)
+{
+    OpenHevcWrapperContext *openHevcContext;
+    int i;
+
+#if HAVE_THREADS
+    if (openHevcContexts->layer_threads)
+        stop_layer_threads(openHevcContexts);
+#endif
+    for (i = openHevcContexts->nb_open; i < nb_layers; i++) {
         openHevcContext = openHevcContexts->wraper[i];
+        if (i)
+            openHevcContext->c->BL_avcontext = openHevcContexts->wraper[i-1]->c;
         if (avcodec_open2(openHevcContext->c, openHevcContext->codec, NULL) < 0) {
             fprintf(stderr, "could not open codec\n");
             return -1;
         }
-        if(i+1 < openHevcContexts->nb_decoders)
-            openHevcContexts->wraper[i+1]->c->BL_avcontext = openHevcContexts->wraper[i]->c;
+        openHevcContexts->nb_open++;
     }
+#if HAVE_THREADS
+    if (openHevcContexts->pipelined && start_layer_threads(openHevcContexts) < 0) {
+        fprintf(stderr, "could not start the layer threads\n");
+        return -1;
+    }
+#else
+    openHevcContexts->pipelined = 0;
+#endif
+    return 0;
+}
+
+int libOpenHevcStartDecoder(OpenHevc_Handle openHevcHandle)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+
+    if (open_decoders(openHevcContexts, openHevcContexts->active_layer + 1) < 0)
+        return -1;
     return 1;
 }
 
@@ -114,8 +318,8 @@ int libOpenHevcDecode(OpenHevc_Handle openHevcHandle, const unsigned char *buff,
     int got_picture[MAX_DECODERS], len=0, i, max_layer;
     OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
     OpenHevcWrapperContext  *openHevcContext;
-    for(i =0; i < MAX_DECODERS; i++)  {
-        got_picture[i]                 = 0;
+    int64_t start = av_gettime();
+    for(i =0; i < openHevcContexts->nb_open; i++)  {
         openHevcContext                = openHevcContexts->wraper[i];
         openHevcContext->c->quality_id = openHevcContexts->active_layer;
 //        printf("quality_id %d \n", openHevcContext->c->quality_id);
@@ -127,15 +331,41 @@ int libOpenHevcDecode(OpenHevc_Handle openHevcHandle, const unsigned char *buff,
             openHevcContext->avpkt.data = NULL;
         }
         openHevcContext->avpkt.pts  = pts;
-        len                         = avcodec_decode_video2( openHevcContext->c, openHevcContext->picture,
-                                                             &got_picture[i], &openHevcContext->avpkt);
-        if(i+1 < openHevcContexts->nb_decoders)
-            openHevcContexts->wraper[i+1]->c->BL_frame = openHevcContexts->wraper[i]->c->BL_frame;
+        if (!openHevcContexts->layer_threads) {
+            decode_layer(openHevcContext);
+            if(i+1 < openHevcContexts->nb_open)
+                openHevcContexts->wraper[i+1]->c->BL_frame = openHevcContexts->wraper[i]->c->BL_frame;
+        }
+    }
+#if HAVE_THREADS
+    if (openHevcContexts->layer_threads) {
+        /* the upper layers get the base layer picture and wait on its rows
+         * through the inter-layer progress of the frame threads */
+        pthread_mutex_lock(&openHevcContexts->layer_mutex);
+        openHevcContexts->au_count++;
+        openHevcContexts->nb_pending = openHevcContexts->nb_layer_threads;
+        pthread_cond_broadcast(&openHevcContexts->layer_cond);
+        pthread_mutex_unlock(&openHevcContexts->layer_mutex);
+
+        decode_layer(openHevcContexts->wraper[0]);
+
+        pthread_mutex_lock(&openHevcContexts->layer_mutex);
+        while (openHevcContexts->nb_pending)
+            pthread_cond_wait(&openHevcContexts->done_cond, &openHevcContexts->layer_mutex);
+        pthread_mutex_unlock(&openHevcContexts->layer_mutex);
+    }
+#endif
+    for(i =0; i < MAX_DECODERS; i++) {
+        got_picture[i] = i < openHevcContexts->nb_open ? openHevcContexts->wraper[i]->got_picture : 0;
+        if (i < openHevcContexts->nb_open)
+            len = openHevcContexts->wraper[i]->len;
     }
     if (len < 0) {
         fprintf(stderr, "Error while decoding frame \n");
         return -1;
     }
+    if (openHevcContexts->frame_period && au_len)
+        adapt_layers(openHevcContexts, av_gettime() - start);
     if(openHevcContexts->set_display)
         max_layer = openHevcContexts->display_layer;
     else
@@ -159,7 +389,7 @@ void libOpenHevcCopyExtraData(OpenHevc_Handle openHevcHandle, unsigned char *ext
     int i;
     OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
     OpenHevcWrapperContext  *openHevcContext;
-    for(i =0; i <= openHevcContexts->active_layer; i++)  {
+    for(i =0; i < openHevcContexts->nb_decoders; i++)  {
         openHevcContext = openHevcContexts->wraper[i];
         openHevcContext->c->extradata = (uint8_t*)av_mallocz(extra_size_alloc);
         memcpy( openHevcContext->c->extradata, extra_data, extra_size_alloc);
@@ -397,6 +627,117 @@ int libOpenHevcGetOutputCpy(OpenHevc_Handle openHevcHandle, int got_picture, Ope
     return 1;
 }
 
+int libOpenHevcGetOutputRef(OpenHevc_Handle openHevcHandle, int got_picture, OpenHevc_FrameRef *openHevcFrame)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext  = openHevcContexts->wraper[openHevcContexts->display_layer];
+    AVFrame *frame;
+
+    openHevcFrame->ref = NULL;
+    if (!got_picture)
+        return 0;
+
+    frame = av_frame_clone(openHevcContext->picture);
+    if (!frame)
+        return -1;
+    openHevcFrame->ref = frame;
+    openHevcFrame->pvY = (void *) frame->data[0];
+    openHevcFrame->pvU = (void *) frame->data[1];
+    openHevcFrame->pvV = (void *) frame->data[2];
+    libOpenHevcGetPictureInfo(openHevcHandle, &openHevcFrame->frameInfo);
+    return 1;
+}
+
+void libOpenHevcReleaseFrame(OpenHevc_FrameRef *openHevcFrame)
+{
+    AVFrame *frame = (AVFrame *) openHevcFrame->ref;
+
+    av_frame_free(&frame);
+    openHevcFrame->ref = NULL;
+    openHevcFrame->pvY = openHevcFrame->pvU = openHevcFrame->pvV = NULL;
+}
+
+static void release_buffer(void *opaque, uint8_t *data)
+{
+    OpenHevcBufferRef *ref = (OpenHevcBufferRef *) opaque;
+
+    ref->release_buffer(ref->opaque, &ref->buffer);
+    av_free(ref);
+}
+
+static int get_buffer(AVCodecContext *c, AVFrame *frame, int flags)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) c->opaque;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    OpenHevcBufferRef *ref;
+    OpenHevc_Buffer   *buffer;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    int w = frame->width, h = frame->height, i;
+
+    avcodec_align_dimensions2(c, &w, &h, linesize_align);
+
+    ref = av_mallocz(sizeof(*ref));
+    if (!ref)
+        return AVERROR(ENOMEM);
+    ref->release_buffer = openHevcContexts->release_buffer;
+    ref->opaque         = openHevcContexts->buffer_opaque;
+
+    buffer                 = &ref->buffer;
+    buffer->nWidth         = w;
+    buffer->nHeight        = h;
+    buffer->nBitDepth      = desc->comp[0].depth_minus1 + 1;
+    buffer->chromat_format = !desc->log2_chroma_w ? YUV444 : desc->log2_chroma_h ? YUV420 : YUV422;
+    buffer->nAlign         = linesize_align[0];
+    if (openHevcContexts->get_buffer(ref->opaque, buffer) < 0) {
+        av_free(ref);
+        return AVERROR(ENOMEM);
+    }
+
+    frame->data[0]     = (uint8_t *) buffer->pvY;
+    frame->data[1]     = (uint8_t *) buffer->pvU;
+    frame->data[2]     = (uint8_t *) buffer->pvV;
+    frame->linesize[0] = buffer->nYPitch;
+    frame->linesize[1] = buffer->nUPitch;
+    frame->linesize[2] = buffer->nVPitch;
+    frame->buf[0]      = av_buffer_create(frame->data[0], buffer->nYPitch * h, release_buffer, ref, 0);
+    if (!frame->buf[0]) {
+        release_buffer(ref, NULL);
+        return AVERROR(ENOMEM);
+    }
+    for (i = 0; i < 3; i++) {
+        if (!frame->data[i] || frame->linesize[i] % buffer->nAlign ||
+            (uintptr_t) frame->data[i] % buffer->nAlign) {
+            fprintf(stderr, "The buffer given for plane %d is not aligned on %d bytes \n", i, buffer->nAlign);
+            av_frame_unref(frame);
+            return AVERROR(EINVAL);
+        }
+    }
+    return 0;
+}
+
+void libOpenHevcSetBufferAllocator(OpenHevc_Handle openHevcHandle, OpenHevc_GetBufferCallback get_buffer_cb,
+                                   OpenHevc_ReleaseBufferCallback release_buffer_cb, void *opaque)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext;
+    int i;
+
+    openHevcContexts->get_buffer     = get_buffer_cb;
+    openHevcContexts->release_buffer = release_buffer_cb;
+    openHevcContexts->buffer_opaque  = opaque;
+    for (i = 0; i < openHevcContexts->nb_decoders; i++) {
+        openHevcContext = openHevcContexts->wraper[i];
+        openHevcContext->c->opaque = openHevcContexts;
+        if (get_buffer_cb && release_buffer_cb) {
+            openHevcContext->c->get_buffer2           = get_buffer;
+            openHevcContext->c->thread_safe_callbacks = 1;
+        } else {
+            openHevcContext->c->get_buffer2           = avcodec_default_get_buffer2;
+            openHevcContext->c->thread_safe_callbacks = 0;
+        }
+    }
+}
+
 void libOpenHevcSetDebugMode(OpenHevc_Handle openHevcHandle, int val)
 {
     if (val == 1)
@@ -411,6 +752,10 @@ void libOpenHevcSetActiveDecoders(OpenHevc_Handle openHevcHandle, int val)
         fprintf(stderr, "The requested layer %d can not be decoded (it exceeds the number of allocated decoders %d ) \n", val, openHevcContexts->nb_decoders);
         openHevcContexts->active_layer = openHevcContexts->nb_decoders-1;
     }
+    openHevcContexts->target_layer = openHevcContexts->active_layer;
+    /* once started, the newly active layers are opened on the fly */
+    if (openHevcContexts->nb_open && openHevcContexts->active_layer >= openHevcContexts->nb_open)
+        open_decoders(openHevcContexts, openHevcContexts->active_layer + 1);
 }
 
 void libOpenHevcSetViewLayers(OpenHevc_Handle openHevcHandle, int val)
@@ -426,6 +771,133 @@ void libOpenHevcSetViewLayers(OpenHevc_Handle openHevcHandle, int val)
 }
 
 
+static void picture_header_callback(AVCodecContext *avctx, const AVHEVCPictureHeader *hdr)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) avctx->opaque;
+    OpenHevc_PictureHeader header;
+
+    header.nTimeStamp        = hdr->pts;
+    header.poc               = hdr->poc;
+    header.nal_unit_type     = hdr->nal_unit_type;
+    header.temporal_id       = hdr->temporal_id;
+    header.layer_id          = hdr->layer_id;
+    header.slice_type        = hdr->slice_type;
+    header.nb_slice_segments = hdr->nb_slice_segments;
+    header.nWidth            = hdr->width;
+    header.nHeight           = hdr->height;
+    header.pic_output_flag   = hdr->pic_output_flag;
+    header.has_md5           = hdr->has_md5;
+    memcpy(header.md5, hdr->md5, sizeof(header.md5));
+    openHevcContexts->header_callback(openHevcContexts->header_opaque, &header);
+}
+
+void libOpenHevcSetHeaderOnly(OpenHevc_Handle openHevcHandle, OpenHevc_PictureHeaderCallback callback, void *opaque)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext;
+    int i;
+
+    openHevcContexts->header_callback = callback;
+    openHevcContexts->header_opaque   = opaque;
+    for (i = 0; i < openHevcContexts->nb_decoders; i++) {
+        openHevcContext = openHevcContexts->wraper[i];
+        openHevcContext->c->opaque              = openHevcContexts;
+        openHevcContext->c->hevc_picture_header = callback ? picture_header_callback : NULL;
+        av_opt_set_int(openHevcContext->c->priv_data, "header-only", !!callback, 0);
+    }
+}
+
+void libOpenHevcSetFramePool(OpenHevc_Handle openHevcHandle, int prealloc, int hugepages)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext;
+    int i;
+
+    for (i = 0; i < openHevcContexts->nb_decoders; i++) {
+        openHevcContext = openHevcContexts->wraper[i];
+        av_opt_set_int(openHevcContext->c->priv_data, "prealloc-frames", !!prealloc, 0);
+        av_opt_set_int(openHevcContext->c->priv_data, "hugepages", !!hugepages, 0);
+    }
+}
+
+void libOpenHevcSetMemoryBudget(OpenHevc_Handle openHevcHandle, int64_t budget)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext;
+    int i;
+
+    for (i = 0; i < openHevcContexts->nb_decoders; i++) {
+        openHevcContext = openHevcContexts->wraper[i];
+        av_opt_set_int(openHevcContext->c->priv_data, "mem-budget", budget, 0);
+    }
+}
+
+void libOpenHevcSetPipelinedLayers(OpenHevc_Handle openHevcHandle, int val)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+
+    openHevcContexts->pipelined = !!val && openHevcContexts->nb_decoders > 1;
+}
+
+void libOpenHevcSetAdaptiveLayers(OpenHevc_Handle openHevcHandle, int64_t frame_period)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+
+    openHevcContexts->frame_period = FFMAX(frame_period, 0);
+    openHevcContexts->au_time      = 0;
+    openHevcContexts->nb_au_held   = 0;
+    if (!openHevcContexts->frame_period && openHevcContexts->active_layer != openHevcContexts->target_layer)
+        libOpenHevcSetActiveDecoders(openHevcHandle, openHevcContexts->target_layer);
+}
+
+int libOpenHevcGetActiveLayer(OpenHevc_Handle openHevcHandle)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+
+    return openHevcContexts->active_layer;
+}
+
+void libOpenHevcSetLowLatency(OpenHevc_Handle openHevcHandle, int val)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext;
+    int i;
+
+    for (i = 0; i < openHevcContexts->nb_decoders; i++) {
+        openHevcContext = openHevcContexts->wraper[i];
+        av_opt_set_int(openHevcContext->c->priv_data, "low-latency", !!val, 0);
+    }
+}
+
+int libOpenHevcGetOutputLatency(OpenHevc_Handle openHevcHandle)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext  = openHevcContexts->wraper[openHevcContexts->display_layer];
+    int64_t latency = 0;
+
+    av_opt_get_int(openHevcContext->c->priv_data, "output-latency", 0, &latency);
+    return latency;
+}
+
+void libOpenHevcGetMemoryUsage(OpenHevc_Handle openHevcHandle, OpenHevc_MemoryUsage *usage)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext;
+    int i;
+
+    memset(usage, 0, sizeof(*usage));
+    for (i = 0; i < openHevcContexts->nb_decoders; i++) {
+        openHevcContext = openHevcContexts->wraper[i];
+        usage->tables     += openHevcContext->mem_usage.tables;
+        usage->scratch    += openHevcContext->mem_usage.scratch;
+        usage->frames     += openHevcContext->mem_usage.frames;
+        usage->frame_meta += openHevcContext->mem_usage.frame_meta;
+        usage->upsampling += openHevcContext->mem_usage.upsampling;
+        usage->total      += openHevcContext->mem_usage.total;
+        usage->peak       += openHevcContext->mem_usage.peak;
+    }
+}
+
 void libOpenHevcSetCheckMD5(OpenHevc_Handle openHevcHandle, int val)
 {
     OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
@@ -452,6 +924,44 @@ void libOpenHevcSetTemporalLayer_id(OpenHevc_Handle openHevcHandle, int val)
     
 }
 
+void libOpenHevcSetDropNonRef(OpenHevc_Handle openHevcHandle, int val)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext;
+    int i;
+
+    for (i = 0; i < openHevcContexts->nb_decoders; i++) {
+        openHevcContext = openHevcContexts->wraper[i];
+        av_opt_set_int(openHevcContext->c->priv_data, "drop-non-ref", !!val, 0);
+    }
+}
+
+void libOpenHevcSetIrapOnly(OpenHevc_Handle openHevcHandle, int val)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext;
+    int i;
+
+    for (i = 0; i < openHevcContexts->nb_decoders; i++) {
+        openHevcContext = openHevcContexts->wraper[i];
+        av_opt_set_int(openHevcContext->c->priv_data, "irap-only", av_clip(val, 0, 2), 0);
+    }
+}
+
+void libOpenHevcSetSkipLoopFilter(OpenHevc_Handle openHevcHandle, int val)
+{
+    OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
+    OpenHevcWrapperContext  *openHevcContext;
+    int i;
+
+    for (i = 0; i < openHevcContexts->nb_decoders; i++) {
+        openHevcContext = openHevcContexts->wraper[i];
+        openHevcContext->c->skip_loop_filter = val >= 2 ? AVDISCARD_ALL     :
+                                               val == 1 ? AVDISCARD_NONREF  :
+                                                          AVDISCARD_DEFAULT;
+    }
+}
+
 void libOpenHevcSetNoCropping(OpenHevc_Handle openHevcHandle, int val)
 {
     OpenHevcWrapperContexts *openHevcContexts = (OpenHevcWrapperContexts *) openHevcHandle;
@@ -470,12 +980,16 @@ void libOpenHevcClose(OpenHevc_Handle openHevcHandle)
     OpenHevcWrapperContext  *openHevcContext;
     int i;
 
+#if HAVE_THREADS
+    if (openHevcContexts->layer_threads)
+        stop_layer_threads(openHevcContexts);
+#endif
     for (i = openHevcContexts->nb_decoders-1; i >=0 ; i--){
         openHevcContext = openHevcContexts->wraper[i];
         avcodec_close(openHevcContext->c);
         av_parser_close(openHevcContext->parser);
         av_freep(&openHevcContext->c);
-        av_freep(&openHevcContext->picture);
+        av_frame_free(&openHevcContext->picture);
         av_freep(&openHevcContext);
     }
     av_freep(&openHevcContexts->wraper);
@@ -76,7 +76,67 @@ typedef struct OpenHevc_Frame_cpy
    OpenHevc_FrameInfo frameInfo;
 } OpenHevc_Frame_cpy;
 
+typedef struct OpenHevc_FrameRef
+{
+   void*        pvY;
+   void*        pvU;
+   void*        pvV;
+   OpenHevc_FrameInfo frameInfo;
+   void*        ref; ///< reference held on the decoded picture
+} OpenHevc_FrameRef;
+
+typedef struct OpenHevc_Buffer
+{
+   int         nWidth;          ///< padded picture size in samples, set by the decoder
+   int         nHeight;
+   int         nBitDepth;
+   int         chromat_format;
+   int         nAlign;          ///< required alignment in bytes of the planes and the pitches
+   void*       pvY;             ///< planes and pitches in bytes, set by the allocator
+   void*       pvU;
+   void*       pvV;
+   int         nYPitch;
+   int         nUPitch;
+   int         nVPitch;
+   void*       opaque;          ///< private data of the allocator
+} OpenHevc_Buffer;
+
+typedef int  (*OpenHevc_GetBufferCallback)(void *opaque, OpenHevc_Buffer *buffer);
+typedef void (*OpenHevc_ReleaseBufferCallback)(void *opaque, OpenHevc_Buffer *buffer);
+
+typedef struct OpenHevc_PictureHeader
+{
+   int64_t     nTimeStamp;
+   int         poc;
+   int         nal_unit_type;
+   int         temporal_id;
+   int         layer_id;
+   int         slice_type;
+   int         nb_slice_segments;
+   int         nWidth;
+   int         nHeight;
+   int         pic_output_flag;
+   int         has_md5;
+   unsigned char md5[3][16];
+} OpenHevc_PictureHeader;
+
+typedef void (*OpenHevc_PictureHeaderCallback)(void *opaque, const OpenHevc_PictureHeader *header);
+
+typedef struct OpenHevc_MemoryUsage
+{
+   int64_t     tables;
+   int64_t     scratch;
+   int64_t     frames;
+   int64_t     frame_meta;
+   int64_t     upsampling;
+   int64_t     total;
+   int64_t     peak;
+} OpenHevc_MemoryUsage;
+
 OpenHevc_Handle libOpenHevcInit(int nb_pthreads, int thread_type);
+/* Decoder for up to nb_layers layers, the decoder of a layer is only opened once the layer is
+ * made active with libOpenHevcSetActiveDecoders. libOpenHevcInit allows two layers. */
+OpenHevc_Handle libOpenHevcInitLayers(int nb_pthreads, int thread_type, int nb_layers);
 int libOpenHevcStartDecoder(OpenHevc_Handle openHevcHandle);
 int  libOpenHevcDecode(OpenHevc_Handle openHevcHandle, const unsigned char *buff, int nal_len, int64_t pts);
 void libOpenHevcGetPictureInfo(OpenHevc_Handle openHevcHandle, OpenHevc_FrameInfo *openHevcFrameInfo);
@@ -85,12 +145,57 @@ void libOpenHevcCopyExtraData(OpenHevc_Handle openHevcHandle, unsigned char *ext
 void libOpenHevcGetPictureInfoCpy(OpenHevc_Handle openHevcHandle, OpenHevc_FrameInfo *openHevcFrameInfo);
 int  libOpenHevcGetOutput(OpenHevc_Handle openHevcHandle, int got_picture, OpenHevc_Frame *openHevcFrame);
 int  libOpenHevcGetOutputCpy(OpenHevc_Handle openHevcHandle, int got_picture, OpenHevc_Frame_cpy *openHevcFrame);
+/* Reference on the output picture without copy, it stays valid across the decode calls
+ * until libOpenHevcReleaseFrame, which may be called from any thread. */
+int  libOpenHevcGetOutputRef(OpenHevc_Handle openHevcHandle, int got_picture, OpenHevc_FrameRef *openHevcFrame);
+void libOpenHevcReleaseFrame(OpenHevc_FrameRef *openHevcFrame);
+/* Pictures are decoded into the buffers of the caller, must be set before libOpenHevcStartDecoder.
+ * The callbacks may be called from the decoder threads, and a buffer is released once the
+ * decoder and every frame reference are done with it. */
+void libOpenHevcSetBufferAllocator(OpenHevc_Handle openHevcHandle, OpenHevc_GetBufferCallback get_buffer,
+                                   OpenHevc_ReleaseBufferCallback release_buffer, void *opaque);
 void libOpenHevcSetCheckMD5(OpenHevc_Handle openHevcHandle, int val);
 void libOpenHevcSetDebugMode(OpenHevc_Handle openHevcHandle, int val);
 void libOpenHevcSetTemporalLayer_id(OpenHevc_Handle openHevcHandle, int val);
 void libOpenHevcSetNoCropping(OpenHevc_Handle openHevcHandle, int val);
+/* Trick play: the sub-layer non-reference pictures of the highest decoded temporal sub-layer and
+ * of the displayed layer are dropped before being parsed. The output pictures keep their own
+ * timestamps. Can be changed while decoding. */
+void libOpenHevcSetDropNonRef(OpenHevc_Handle openHevcHandle, int val);
+/* Keyframe decoding for thumbnails and seek previews, 1 decodes the IRAP pictures only,
+ * 2 also skips their deblocking and SAO. */
+void libOpenHevcSetIrapOnly(OpenHevc_Handle openHevcHandle, int val);
+/* Loop filter skipping, 1 skips the deblocking and SAO of the non-reference pictures,
+ * without drift. 2 skips them for all the pictures, the reference pictures included, so
+ * the prediction drifts until the next IRAP picture. */
+void libOpenHevcSetSkipLoopFilter(OpenHevc_Handle openHevcHandle, int val);
 void libOpenHevcSetActiveDecoders(OpenHevc_Handle openHevcHandle, int val);
 void libOpenHevcSetViewLayers(OpenHevc_Handle openHevcHandle, int val);
+/* Header-only decoding, must be set before libOpenHevcStartDecoder. */
+void libOpenHevcSetHeaderOnly(OpenHevc_Handle openHevcHandle, OpenHevc_PictureHeaderCallback callback, void *opaque);
+/* Picture buffer pre-allocation and huge pages, must be set before libOpenHevcStartDecoder. */
+void libOpenHevcSetFramePool(OpenHevc_Handle openHevcHandle, int prealloc, int hugepages);
+/* Footprint cap in bytes of each layer decoder, must be set before libOpenHevcStartDecoder.
+ * The streams which do not fit with the configured threads are rejected. The NAL unit
+ * buffers, which follow the size of the packets, are not part of the estimate. */
+void libOpenHevcSetMemoryBudget(OpenHevc_Handle openHevcHandle, int64_t budget);
+/* Footprint in bytes of all the layer decoders. */
+void libOpenHevcGetMemoryUsage(OpenHevc_Handle openHevcHandle, OpenHevc_MemoryUsage *usage);
+/* Pipelined layers, must be set before libOpenHevcStartDecoder. The layer decoders work on
+ * the same access unit at once, each enhancement layer following the rows of the layer below.
+ * Requires frame threading, the layers are decoded one after the other otherwise. */
+void libOpenHevcSetPipelinedLayers(OpenHevc_Handle openHevcHandle, int val);
+/* Automatic layer switching: the decoder drops to the base layer when the access units take
+ * longer than frame_period us to decode, and goes back to the layer set with
+ * libOpenHevcSetActiveDecoders at its next IRAP picture once there is headroom again.
+ * 0 turns it off. */
+void libOpenHevcSetAdaptiveLayers(OpenHevc_Handle openHevcHandle, int64_t frame_period);
+/* Layer being decoded, it follows the automatic layer switching. */
+int  libOpenHevcGetActiveLayer(OpenHevc_Handle openHevcHandle);
+/* Low-latency output, must be set before libOpenHevcStartDecoder. */
+void libOpenHevcSetLowLatency(OpenHevc_Handle openHevcHandle, int val);
+/* Pictures of latency added by the reordering and the frame threads of the displayed layer. */
+int  libOpenHevcGetOutputLatency(OpenHevc_Handle openHevcHandle);
 void libOpenHevcClose(OpenHevc_Handle openHevcHandle);
 void libOpenHevcFlush(OpenHevc_Handle openHevcHandle);
 void libOpenHevcFlushSVC(OpenHevc_Handle openHevcHandle, int decoderId);
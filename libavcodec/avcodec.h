@@ -1217,6 +1217,40 @@ enum AVFieldOrder {
     AV_FIELD_BT,          //< Bottom coded first, top displayed first
 };
 
+/**
+ * Picture level syntax reported by the HEVC decoder in header-only mode.
+ */
+typedef struct AVHEVCPictureHeader {
+    int64_t pts;                 ///< pts of the packet holding the picture
+    int poc;
+    int nal_unit_type;
+    int temporal_id;
+    int layer_id;
+    int slice_type;              ///< type of the first slice segment
+    int nb_slice_segments;
+    int pps_id;
+    int width;
+    int height;
+    int pic_output_flag;
+    int no_output_of_prior_pics_flag;
+    int picture_structure;       ///< from the picture timing SEI
+    int has_md5;                 ///< a decoded picture hash SEI was found
+    uint8_t md5[3][16];
+} AVHEVCPictureHeader;
+
+/**
+ * Memory footprint of an HEVC decoder, frame threads included, in bytes.
+ */
+typedef struct AVHEVCMemoryUsage {
+    int64_t tables;              ///< tables sized by the SPS, SAO line buffers
+    int64_t scratch;             ///< local contexts and their scratch areas
+    int64_t frames;              ///< pictures held by the DPB and the frame threads
+    int64_t frame_meta;          ///< MV fields and reference lists of those pictures
+    int64_t upsampling;          ///< SHVC inter-layer upsampling buffers
+    int64_t total;
+    int64_t peak;                ///< highest total since the structure was cleared
+} AVHEVCMemoryUsage;
+
 /**
  * main external API structure.
  * New fields can be added to the end with minor version bumps.
@@ -3137,6 +3171,22 @@ typedef struct AVCodecContext {
     void *BL_frame;
     void *BL_avcontext;
     int quality_id;
+
+    /**
+     * Called by the HEVC decoder for every picture when its "header-only"
+     * option is set. Nothing is reconstructed or output in that mode.
+     * May be called from a frame thread.
+     */
+    void (*hevc_picture_header)(struct AVCodecContext *avctx,
+                                const AVHEVCPictureHeader *hdr);
+
+    /**
+     * Set by the user before avcodec_open2(), updated by the HEVC decoder
+     * at every SPS activation and picture allocation. With frame threads
+     * it is only updated from the calling thread, when a packet is handed
+     * to the next frame thread.
+     */
+    AVHEVCMemoryUsage *hevc_mem_usage;
 } AVCodecContext;
 
 AVRational av_codec_get_pkt_timebase         (const AVCodecContext *avctx);
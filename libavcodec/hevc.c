@@ -27,6 +27,7 @@
 #include "libavutil/atomic.h"
 #include "libavutil/attributes.h"
 #include "libavutil/common.h"
+#include "libavutil/imgutils.h"
 #include "libavutil/internal.h"
 #include "libavutil/md5.h"
 #include "libavutil/opt.h"
@@ -62,6 +63,8 @@ static void printf_ref_pic_list(HEVCContext *s);
 /* free everything allocated  by pic_arrays_init() */
 static void pic_arrays_free(HEVCContext *s)
 {
+    int i;
+
     av_freep(&s->sao);
     av_freep(&s->deblock);
 
@@ -79,12 +82,19 @@ static void pic_arrays_free(HEVCContext *s)
     av_freep(&s->horizontal_bs);
     av_freep(&s->vertical_bs);
 
+    for (i = 0; i < 3; i++) {
+        av_freep(&s->sao_pixel_buffer_h[i]);
+        av_freep(&s->sao_pixel_buffer_v[i]);
+    }
+
     av_freep(&s->sh.entry_point_offset);
     av_freep(&s->sh.size);
     av_freep(&s->sh.offset);
 
-    av_buffer_pool_uninit(&s->tab_mvf_pool);
-    av_buffer_pool_uninit(&s->rpl_tab_pool);
+    av_freep(&s->entry_arg);
+    av_freep(&s->entry_ret);
+
+    av_buffer_pool_uninit(&s->frame_meta_pool);
 
 #ifdef SVC_EXTENSION
 #if ACTIVE_BOTH_FRAME_AND_PU
@@ -92,6 +102,7 @@ static void pic_arrays_free(HEVCContext *s)
     av_freep(&s->buffer_frame[1]);
     av_freep(&s->buffer_frame[2]);
     av_freep(&s->is_upsampled);
+    s->is_mv_upsampled = NULL;
 #else
 #if !ACTIVE_PU_UPSAMPLING
     av_freep(&s->buffer_frame[0]);
@@ -99,6 +110,7 @@ static void pic_arrays_free(HEVCContext *s)
     av_freep(&s->buffer_frame[2]);
 #else
     av_freep(&s->is_upsampled);
+    s->is_mv_upsampled = NULL;
 #endif
 #endif    
 #endif
@@ -119,14 +131,18 @@ static int pic_arrays_init(HEVCContext *s, const HEVCSPS *sps)
                            ((height >> log2_min_cb_size) + 1);
     int ctb_count        = sps->ctb_width * sps->ctb_height;
     int min_pu_size      = sps->min_pu_width * sps->min_pu_height;
+    unsigned long dynamic_alloc = s->dynamic_alloc;
+    int i;
+
+    s->scratch_allocs++;
 
     s->bs_width  = (width  >> 2);
     s->bs_height = (height >> 2);
 
     s->sao           = av_mallocz_array(ctb_count, sizeof(*s->sao));
     s->deblock       = av_mallocz_array(ctb_count, sizeof(*s->deblock));
-    s->dynamic_alloc += sizeof(*s->sao);
-    s->dynamic_alloc += sizeof(*s->deblock);
+    s->dynamic_alloc += ctb_count * sizeof(*s->sao);
+    s->dynamic_alloc += ctb_count * sizeof(*s->deblock);
 //    s->dynamic_alloc += pic_size;
 
     if (!s->sao || !s->deblock)
@@ -142,7 +158,7 @@ static int pic_arrays_init(HEVCContext *s, const HEVCSPS *sps)
     if (!s->skip_flag || !s->tab_ct_depth)
         goto fail;
 
-    s->cbf_luma = av_malloc(sps->min_tb_width * sps->min_tb_height);
+    s->cbf_luma = av_mallocz(sps->min_tb_width * sps->min_tb_height);
     s->tab_ipm  = av_mallocz(min_pu_size);
     s->is_pcm   = av_mallocz(min_pu_size);
 
@@ -175,15 +191,51 @@ static int pic_arrays_init(HEVCContext *s, const HEVCSPS *sps)
     if (!s->horizontal_bs || !s->vertical_bs)
         goto fail;
 
-    s->tab_mvf_pool = av_buffer_pool_init(min_pu_size * sizeof(MvField),
-                                          av_buffer_allocz);
-    s->rpl_tab_pool = av_buffer_pool_init(ctb_count * sizeof(RefPicListTab),
-                                          av_buffer_allocz);
-    s->dynamic_alloc += (min_pu_size * sizeof(MvField));
-    s->dynamic_alloc += (ctb_count * sizeof(RefPicListTab));
+    if (sps->sao_enabled) {
+        int c_count = sps->chroma_array_type ? 3 : 1;
+
+        for (i = 0; i < c_count; i++) {
+            int w = sps->width  >> sps->hshift[i];
+            int h = sps->height >> sps->vshift[i];
+            s->sao_pixel_buffer_h[i] = av_malloc((w * 2 * sps->ctb_height) << sps->pixel_shift);
+            s->sao_pixel_buffer_v[i] = av_malloc((h * 2 * sps->ctb_width)  << sps->pixel_shift);
+            s->dynamic_alloc += (w * 2 * sps->ctb_height) << sps->pixel_shift;
+            s->dynamic_alloc += (h * 2 * sps->ctb_width)  << sps->pixel_shift;
+            if (!s->sao_pixel_buffer_h[i] || !s->sao_pixel_buffer_v[i])
+                goto fail;
+        }
+    }
+
+    /* there are at most one entry point per CTB (tiles) */
+    s->sh.entry_point_offset = av_malloc_array(ctb_count, sizeof(*s->sh.entry_point_offset));
+    s->sh.offset             = av_malloc_array(ctb_count, sizeof(*s->sh.offset));
+    s->sh.size               = av_malloc_array(ctb_count, sizeof(*s->sh.size));
+    s->entry_arg             = av_malloc_array(ctb_count + 1, sizeof(*s->entry_arg));
+    s->entry_ret             = av_malloc_array(ctb_count + 1, sizeof(*s->entry_ret));
+    s->dynamic_alloc += 3 * ctb_count * sizeof(int);
+    s->dynamic_alloc += 2 * (ctb_count + 1) * sizeof(int);
+    if (!s->sh.entry_point_offset || !s->sh.offset || !s->sh.size ||
+        !s->entry_arg || !s->entry_ret)
+        goto fail;
+    for (i = 0; i <= ctb_count; i++)
+        s->entry_arg[i] = i;
+    if (ff_alloc_entries(s->avctx, ctb_count + 1) < 0)
+        goto fail;
 
-    if (!s->tab_mvf_pool || !s->rpl_tab_pool)
+    /* MV field, per-slice ref pic lists and CTB to slice map of a picture
+     * live in one pooled block, reused as is by the next picture */
+    s->frame_meta_rpl_offset = FFALIGN(min_pu_size * sizeof(MvField), 32);
+    s->frame_meta_map_offset = s->frame_meta_rpl_offset +
+                               MAX_SLICES_IN_FRAME * sizeof(RefPicListTab);
+    s->frame_meta_pool = av_buffer_pool_init(s->frame_meta_map_offset + ctb_count,
+                                             av_buffer_allocz);
+    s->mem_frame_meta = s->frame_meta_map_offset + ctb_count;
+    s->mem_tables     = s->dynamic_alloc - dynamic_alloc;
+    s->dynamic_alloc += s->mem_frame_meta;
+
+    if (!s->frame_meta_pool)
         goto fail;
+    s->mem_upsampling = 0;
 #ifdef SVC_EXTENSION
     if(s->decoder_id)    {
 
@@ -191,18 +243,23 @@ static int pic_arrays_init(HEVCContext *s, const HEVCSPS *sps)
         s->buffer_frame[0] = av_malloc(pic_size*sizeof(short));
         s->buffer_frame[1] = av_malloc((pic_size>>2)*sizeof(short));
         s->buffer_frame[2] = av_malloc((pic_size>>2)*sizeof(short));
-        s->is_upsampled = av_malloc(sps->ctb_width * sps->ctb_height);
-        s->dynamic_alloc += (sps->ctb_width * sps->ctb_height);
+        s->is_upsampled    = av_malloc(2 * sps->ctb_width * sps->ctb_height);
+        s->is_mv_upsampled = s->is_upsampled + sps->ctb_width * sps->ctb_height;
+        s->mem_upsampling = (pic_size + 2 * (pic_size >> 2)) * sizeof(short) +
+                            2 * sps->ctb_width * sps->ctb_height;
 #else
 #if !ACTIVE_PU_UPSAMPLING
         s->buffer_frame[0] = av_malloc(pic_size*sizeof(short));
         s->buffer_frame[1] = av_malloc((pic_size>>2)*sizeof(short));
         s->buffer_frame[2] = av_malloc((pic_size>>2)*sizeof(short));
+        s->mem_upsampling = (pic_size + 2 * (pic_size >> 2)) * sizeof(short);
 #else
-        s->is_upsampled = av_malloc(sps->ctb_width * sps->ctb_height);
-        s->dynamic_alloc += (sps->ctb_width * sps->ctb_height);
+        s->is_upsampled    = av_malloc(2 * sps->ctb_width * sps->ctb_height);
+        s->is_mv_upsampled = s->is_upsampled + sps->ctb_width * sps->ctb_height;
+        s->mem_upsampling = 2 * sps->ctb_width * sps->ctb_height;
 #endif
 #endif
+        s->dynamic_alloc += s->mem_upsampling;
     }
 #endif
 
@@ -366,27 +423,20 @@ static int decode_lt_rps(HEVCContext *s, LongTermRPS *rps, GetBitContext *gb)
     return 0;
 }
 
-static int get_buffer_sao(HEVCContext *s, AVFrame *frame, const HEVCSPS *sps)
+/* size of a picture buffer handed out by the frame pool, edges excluded */
+static int64_t picture_size(AVCodecContext *avctx, const HEVCSPS *sps)
 {
-    int ret, i;
-
-    frame->width  = s->avctx->width  + 2;
-    frame->height = s->avctx->height + 2;
-    if ((ret = ff_get_buffer(s->avctx, frame, AV_GET_BUFFER_FLAG_REF)) < 0)
-        return ret;
-    for (i = 0; frame->data[i]; i++) {
-        int offset = frame->linesize[i] + (1 << sps->pixel_shift);
-        frame->data[i] += offset;
-    }
-    frame->width  = s->avctx->width;
-    frame->height = s->avctx->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    int w = sps->width;
+    int h = sps->height;
 
-    return 0;
+    avcodec_align_dimensions2(avctx, &w, &h, linesize_align);
+    return av_image_get_buffer_size(sps->pix_fmt, w, h, linesize_align[0]);
 }
 
 static int set_sps(HEVCContext *s, const HEVCSPS *sps)
 {
-    int ret;
+    int ret, nb_frames;
     unsigned int num = 0, den = 0;
 
     pic_arrays_free(s);
@@ -422,14 +472,14 @@ static int set_sps(HEVCContext *s, const HEVCSPS *sps)
     ff_hevc_dsp_init (&s->hevcdsp, sps->bit_depth);
     ff_videodsp_init (&s->vdsp,    sps->bit_depth);
 
-    if (sps->sao_enabled) {
-        av_frame_unref(s->tmp_frame);
-        ret = get_buffer_sao(s, s->tmp_frame, sps);
-        s->sao_frame = s->tmp_frame;
-    }
-
     s->sps = sps;
     s->vps = (HEVCVPS*) s->vps_list[s->sps->vps_id]->data;
+    if (s->decoder_id && !s->vps->vps_extension_flag) {
+        /* the VPS has been replaced by one without the extension fields */
+        av_log(s->avctx, AV_LOG_ERROR, "VPS %d has no extension\n", sps->vps_id);
+        ret = AVERROR_INVALIDDATA;
+        goto fail;
+    }
 
     if (s->vps->vps_timing_info_present_flag) {
         num = s->vps->vps_num_units_in_tick;
@@ -499,6 +549,35 @@ static int set_sps(HEVCContext *s, const HEVCSPS *sps)
                     av_log(s->avctx, AV_LOG_INFO, "DEFAULT mode: SSE optimizations are not implemented for spatial scalability with a ratio different from x2 and x1.5 widthBL %d heightBL %d \n", widthBL<<1, heightBL<<1);
                 }
     }
+
+    s->mem_picture = picture_size(s->avctx, sps);
+
+    /* the DPB, the picture being decoded and the ones in flight in the
+     * other frame threads */
+    nb_frames = sps->temporal_layer[sps->max_sub_layers - 1].max_dec_pic_buffering + 1;
+    if (s->threads_type & FF_THREAD_FRAME)
+        nb_frames += s->avctx->thread_count_frame - 1;
+
+    if (s->mem_budget && ff_hevc_mem_estimate(s, nb_frames) > s->mem_budget) {
+        av_log(s->avctx, AV_LOG_ERROR,
+               "SPS %dx%d needs %"PRId64" bytes with %d frame threads, over the %"PRId64" bytes budget.\n",
+               sps->width, sps->height, ff_hevc_mem_estimate(s, nb_frames),
+               s->avctx->thread_count_frame, s->mem_budget);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    if (s->prealloc_frames) {
+        /* one more picture of headroom, as long as the budget allows it */
+        if (!s->mem_budget || ff_hevc_mem_estimate(s, nb_frames + 1) <= s->mem_budget)
+            nb_frames++;
+        ret = ff_prealloc_buffers(s->avctx, nb_frames);
+        if (ret < 0)
+            goto fail;
+    }
+
+    if (!(s->threads_type & FF_THREAD_FRAME))
+        ff_hevc_update_mem_usage(s);
     return 0;
 fail:
     pic_arrays_free(s);
@@ -517,6 +596,16 @@ static int is_sps_exist(HEVCContext *s, const HEVCSPS* last_sps)
     return 0;
 }
 
+/* A sub-layer non-reference picture is only referenced from the higher
+ * sub-layers, and from the upper layers of the access unit, so nothing
+ * decoded is predicted from it in the highest decoded sub-layer and layer. */
+static int is_non_ref_pic(HEVCContext *s, int nal_unit_type, int nuh_layer_id, int temporal_id)
+{
+    return s->vps && nal_unit_type < NAL_BLA_W_LP && !(nal_unit_type & 1) &&
+           nuh_layer_id >= s->avctx->quality_id &&
+           temporal_id >= FFMIN(s->temporal_layer_id, s->vps->vps_max_sub_layers - 1);
+}
+
 static int hls_slice_header(HEVCContext *s)
 {
     GetBitContext *gb   = &s->HEVClc->gb;
@@ -558,7 +647,7 @@ static int hls_slice_header(HEVCContext *s)
 	}
 
     print_cabac("first_slice_segment_in_pic_flag", sh->first_slice_in_pic_flag);
-    if ((IS_IDR(s) || IS_BLA(s)) && sh->first_slice_in_pic_flag) {
+    if ((IS_IDR(s) || IS_BLA(s) || IS_CRA_AS_BLA(s)) && sh->first_slice_in_pic_flag) {
         s->seq_decode = (s->seq_decode + 1) & 0xff;
         s->max_ra     = INT_MAX;
         if (IS_IDR(s))
@@ -803,8 +892,10 @@ else
 #ifdef REF_IDX_FRAMEWORK
 #ifdef JCTVC_M0458_INTERLAYER_RPS_SIG
         s->sh.active_num_ILR_ref_idx = 0;
-        NumILRRefIdx = s->vps->m_numDirectRefLayers[s->nuh_layer_id];
-        if (s->nuh_layer_id > 0 && NumILRRefIdx>0) {
+        /* the extension fields are only allocated with vps_extension_flag */
+        NumILRRefIdx = s->nuh_layer_id > 0 && s->vps->vps_extension_flag ?
+                       s->vps->m_numDirectRefLayers[s->nuh_layer_id] : 0;
+        if (NumILRRefIdx > 0) {
             s->sh.inter_layer_pred_enabled_flag = get_bits1(gb);
             print_cabac("inter_layer_pred_enabled_flag", s->sh.inter_layer_pred_enabled_flag );
             if (s->sh.inter_layer_pred_enabled_flag) {
@@ -996,6 +1087,19 @@ else
         } else {
             sh->slice_loop_filter_across_slices_enabled_flag = s->pps->seq_loop_filter_across_slices_enabled_flag;
         } 
+
+        /* skip the deblocking and SAO for previews and overloaded decoders.
+         * Nothing decoded is predicted from a skipped non-reference picture,
+         * or from an IRAP-only one, so these do not drift. AVDISCARD_NONKEY
+         * and AVDISCARD_ALL also skip the reference pictures, and the drift
+         * lasts until the next IRAP picture. */
+        s->no_loop_filter = s->irap_only == 2 ||
+                            s->avctx->skip_loop_filter >= AVDISCARD_ALL ||
+                            (s->avctx->skip_loop_filter >= AVDISCARD_NONKEY && !IS_IRAP(s)) ||
+                            (s->avctx->skip_loop_filter >= AVDISCARD_NONREF &&
+                             is_non_ref_pic(s, s->nal_unit_type, s->nuh_layer_id, s->temporal_id));
+        if (s->no_loop_filter)
+            sh->disable_deblocking_filter_flag = 1;
     } else if (!s->slice_initialized) {
         av_log(s->avctx, AV_LOG_ERROR, "Independent slice segment missing.\n");
         return AVERROR_INVALIDDATA;
@@ -1005,8 +1109,8 @@ else
     if (s->pps->tiles_enabled_flag || s->pps->entropy_coding_sync_enabled_flag) {
         sh->num_entry_point_offsets = get_ue_golomb_long(gb);
         print_cabac("num_entry_point_offsets", sh->num_entry_point_offsets);
-        if(s->pps->entropy_coding_sync_enabled_flag) {
-            if(sh->num_entry_point_offsets < 0) {
+        if(s->pps->entropy_coding_sync_enabled_flag && !s->pps->tiles_enabled_flag) {
+            if(sh->num_entry_point_offsets > s->sps->ctb_height || sh->num_entry_point_offsets < 0) {
                 av_log(s->avctx, AV_LOG_ERROR,
                    "The number of entries %d is higher than the number of CTB rows %d \n",
                    sh->num_entry_point_offsets,
@@ -1027,17 +1131,6 @@ else
             print_cabac("offset_len_minus1", offset_len-1);
             int segments = offset_len >> 4;
             int rest = (offset_len & 15);
-            av_freep(&sh->entry_point_offset);
-            av_freep(&sh->offset);
-            av_freep(&sh->size);
-            sh->entry_point_offset = av_malloc(sh->num_entry_point_offsets * sizeof(int));
-            sh->offset = av_malloc(sh->num_entry_point_offsets * sizeof(int));
-            sh->size = av_malloc(sh->num_entry_point_offsets * sizeof(int));
-            if (!sh->entry_point_offset || !sh->offset || !sh->size) {
-                sh->num_entry_point_offsets = 0;
-                av_log(s->avctx, AV_LOG_ERROR, "Failed to allocate memory\n");
-                return AVERROR(ENOMEM);
-            }
             for (i = 0; i < sh->num_entry_point_offsets; i++) {
                 int val = 0;
                 for (j = 0; j < segments; j++) {
@@ -1959,10 +2052,7 @@ static void hevc_await_progress(HEVCContext *s, HEVCFrame *ref,
 static void hevc_await_progress_bl(HEVCContext *s, HEVCFrame *ref,
                                 const Mv *mv, int y0)
 {
-    int y = (mv->y >> 2) + y0 + (1<<s->sps->log2_ctb_size)*2 + 9;
-    int bl_y = (( (y  - s->sps->pic_conf_win.top_offset) * s->up_filter_inf.scaleYLum + s->up_filter_inf.addYLum) >> 12) >> 4;
-    if (s->threads_type & FF_THREAD_FRAME )
-        ff_thread_await_progress(&s->BL_frame->tf, bl_y, 0);
+    ff_hevc_await_bl_row(s, (mv->y >> 2) + y0 + (1<<s->sps->log2_ctb_size)*2 + 9);
 }
 
 static void hls_prediction_unit(HEVCContext *s, int x0, int y0,
@@ -2023,9 +2113,6 @@ static void hls_prediction_unit(HEVCContext *s, int x0, int y0,
             if (inter_pred_idc != PRED_L1) {
                 if (s->sh.nb_refs[L0]) {
                     current_mv.ref_idx[0] = ff_hevc_ref_idx_lx_decode(s, s->sh.nb_refs[L0]);
-#ifdef TEST_MV_POC
-                    current_mv.poc[0] = refPicList[0].list[current_mv.ref_idx[0]];
-#endif
                 }
                 current_mv.pred_flag = PF_L0;
                 ff_hevc_hls_mvd_coding(s, x0, y0, 0);
@@ -2040,9 +2127,6 @@ static void hls_prediction_unit(HEVCContext *s, int x0, int y0,
             if (inter_pred_idc != PRED_L0) {
                 if (s->sh.nb_refs[L1]) {
                     current_mv.ref_idx[1] = ff_hevc_ref_idx_lx_decode(s, s->sh.nb_refs[L1]);
-#ifdef TEST_MV_POC
-                    current_mv.poc[1] = refPicList[1].list[current_mv.ref_idx[1]];
-#endif
                 }
 
                 if (s->sh.mvd_l1_zero_flag == 1 && inter_pred_idc == PRED_BI) {
@@ -2589,6 +2673,27 @@ static int hls_coding_quadtree(HEVCContext *s, int x0, int y0,
     return 0;
 }
 
+/* The boundary strengths and the luma cbf are only written where the CTB
+ * has an edge or a coded block, clear its area before decoding it. */
+static void clear_ctb_tables(HEVCContext *s, int x_ctb, int y_ctb)
+{
+    int ctb_size     = 1 << s->sps->log2_ctb_size;
+    int log2_min_tb  = s->sps->log2_min_tb_size;
+    int min_tb_width = s->sps->min_tb_width;
+    int width        = FFMIN(ctb_size, s->sps->width  - x_ctb);
+    int height       = FFMIN(ctb_size, s->sps->height - y_ctb);
+    int x_tb         = x_ctb >> log2_min_tb;
+    int y_tb         = y_ctb >> log2_min_tb;
+    int y;
+
+    for (y = y_ctb; y < y_ctb + height; y += 4) {
+        memset(&s->horizontal_bs[(x_ctb + y * s->bs_width) >> 2], 0, width >> 2);
+        memset(&s->vertical_bs  [(x_ctb + y * s->bs_width) >> 2], 0, width >> 2);
+    }
+    for (y = y_tb; y < y_tb + (height >> log2_min_tb); y++)
+        memset(&s->cbf_luma[y * min_tb_width + x_tb], 0, width >> log2_min_tb);
+}
+
 static void hls_decode_neighbour(HEVCContext *s, int x_ctb, int y_ctb,
                                  int ctb_addr_ts)
 {
@@ -2601,6 +2706,7 @@ static void hls_decode_neighbour(HEVCContext *s, int x_ctb, int y_ctb,
     int slice_left_boundary, slice_up_boundary;
 
     s->tab_slice_address[ctb_addr_rs] = s->sh.slice_addr;
+    clear_ctb_tables(s, x_ctb, y_ctb);
 
     if (s->pps->entropy_coding_sync_enabled_flag) {
         if (x_ctb == 0 && (y_ctb & (ctb_size - 1)) == 0)
@@ -3014,15 +3120,75 @@ static void slices_filters(HEVCContext *s)
 #endif
 
 
+#define SCRATCH_ALIGN 64
+#define SCRATCH_EDGE_SIZE  FFALIGN(EDGE_EMU_BUFFER_SIZE, SCRATCH_ALIGN)
+#define SCRATCH_COEFF_SIZE FFALIGN(MAX_TB_SIZE * MAX_TB_SIZE * sizeof(int16_t), SCRATCH_ALIGN)
+#define SCRATCH_SIZE       (2 * SCRATCH_EDGE_SIZE + 2 * SCRATCH_COEFF_SIZE + SCRATCH_ALIGN - 1)
+#define SCRATCH_UP_SIZE    (MAX_EDGE_BUFFER_SIZE * sizeof(int16_t) + SCRATCH_ALIGN - 1)
+
+static void free_local_scratch(HEVCLocalContext *lc)
+{
+    av_freep(&lc->scratch_buf);
+    av_freep(&lc->scratch_up_buf);
+    lc->edge_emu_buffer      = NULL;
+    lc->edge_emu_buffer2     = NULL;
+    lc->tu.coeffs[0]         = NULL;
+    lc->tu.coeffs[1]         = NULL;
+    lc->edge_emu_buffer_up_v = NULL;
+}
+
+/* The scratch areas of a local context live outside of it, so that the
+ * parsing state stays within a few cache lines. They are only allocated
+ * when a thread decodes its first slice, the upsampling one when it
+ * decodes its first enhancement layer slice. */
+static int alloc_local_scratch(HEVCContext *s, HEVCLocalContext *lc)
+{
+    if (!lc->scratch_buf) {
+        int edge_size  = SCRATCH_EDGE_SIZE;
+        int coeff_size = SCRATCH_COEFF_SIZE;
+        uint8_t *buf;
+
+        lc->scratch_buf = av_malloc(SCRATCH_SIZE);
+        if (!lc->scratch_buf)
+            return AVERROR(ENOMEM);
+        s->dynamic_alloc += SCRATCH_SIZE;
+        s->mem_scratch   += SCRATCH_SIZE;
+
+        buf = (uint8_t *)FFALIGN((uintptr_t)lc->scratch_buf, SCRATCH_ALIGN);
+        lc->edge_emu_buffer  = buf;
+        lc->edge_emu_buffer2 = buf + edge_size;
+        lc->tu.coeffs[0]     = (int16_t *)(buf + 2 * edge_size);
+        lc->tu.coeffs[1]     = (int16_t *)(buf + 2 * edge_size + coeff_size);
+    }
+#ifdef SVC_EXTENSION
+    if (s->nuh_layer_id && !lc->scratch_up_buf) {
+        lc->scratch_up_buf = av_malloc(SCRATCH_UP_SIZE);
+        if (!lc->scratch_up_buf)
+            return AVERROR(ENOMEM);
+        s->dynamic_alloc += SCRATCH_UP_SIZE;
+        s->mem_scratch   += SCRATCH_UP_SIZE;
+
+        lc->edge_emu_buffer_up_v = (int16_t *)FFALIGN((uintptr_t)lc->scratch_up_buf, SCRATCH_ALIGN);
+    }
+#endif
+    return 0;
+}
+
 static int hls_slice_data(HEVCContext *s, const uint8_t *nal, int length)
 {
     HEVCLocalContext *lc = s->HEVClc;
-    int *ret = av_malloc((s->sh.num_entry_point_offsets + 1) * sizeof(int));
-    int *arg = av_malloc((s->sh.num_entry_point_offsets + 1) * sizeof(int));
+    int *ret = s->entry_ret;
+    int *arg = s->entry_arg;
     int offset;
     int startheader, cmpt = 0;
     int i, j, res = 0;
 
+    for (i = 0; i < s->threads_number; i++) {
+        res = alloc_local_scratch(s, s->HEVClcList[i]);
+        if (res < 0)
+            return res;
+    }
+
     ff_alloc_entries(s->avctx, s->sh.num_entry_point_offsets + 1);
 
     if (s->sh.num_entry_point_offsets > 0) {
@@ -3074,10 +3240,7 @@ static int hls_slice_data(HEVCContext *s, const uint8_t *nal, int length)
         s->sList[i]->HEVClc = s->HEVClcList[i];
     }
 
-    for (i = 0; i <= s->sh.num_entry_point_offsets; i++) {
-        arg[i] = i;
-        ret[i] = 0;
-    }
+    memset(ret, 0, (s->sh.num_entry_point_offsets + 1) * sizeof(*ret));
 
     if (s->pps->entropy_coding_sync_enabled_flag && s->pps->tiles_enabled_flag && s->threads_number!=1)
         s->avctx->execute2(s->avctx, (void *) hls_decode_entry_wpp_in_tiles, arg, ret, s->sh.num_entry_point_offsets + 1);
@@ -3090,8 +3253,6 @@ static int hls_slice_data(HEVCContext *s, const uint8_t *nal, int length)
 
     res = ret[s->threads_number==1 ? 0:s->sh.num_entry_point_offsets];
 
-    av_free(ret);
-    av_free(arg);
     return res;
 }
 
@@ -3124,6 +3285,28 @@ static int hls_nal_unit(HEVCContext *s)
     return ret;
 }
 
+static void record_picture_header(HEVCContext *s)
+{
+    AVHEVCPictureHeader *hdr = &s->pic_header;
+
+    if (s->sh.first_slice_in_pic_flag) {
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->poc                          = s->poc;
+        hdr->nal_unit_type                = s->nal_unit_type;
+        hdr->temporal_id                  = s->temporal_id;
+        hdr->layer_id                     = s->nuh_layer_id;
+        hdr->slice_type                   = s->sh.slice_type;
+        hdr->pps_id                       = s->sh.pps_id;
+        hdr->width                        = s->sps->output_width;
+        hdr->height                       = s->sps->output_height;
+        hdr->pic_output_flag              = s->sh.pic_output_flag;
+        hdr->no_output_of_prior_pics_flag = s->sh.no_output_of_prior_pics_flag;
+    } else if (!hdr->nb_slice_segments) {
+        return;
+    }
+    hdr->nb_slice_segments++;
+}
+
 static int set_side_data(HEVCContext *s)
 {
     AVFrame *out = s->ref->frame;
@@ -3167,25 +3350,19 @@ static int hevc_ref_frame(HEVCContext *s, HEVCFrame *dst, HEVCFrame *src)
     if (ret < 0)
         return ret;
 
-    dst->tab_mvf_buf = av_buffer_ref(src->tab_mvf_buf);
-    if (!dst->tab_mvf_buf)
-        goto fail;
-    dst->tab_mvf = src->tab_mvf;
-
-    dst->rpl_tab_buf = av_buffer_ref(src->rpl_tab_buf);
-    if (!dst->rpl_tab_buf)
-        goto fail;
-    dst->rpl_tab = src->rpl_tab;
-
-    dst->rpl_buf = av_buffer_ref(src->rpl_buf);
-    if (!dst->rpl_buf)
+    dst->meta_buf = av_buffer_ref(src->meta_buf);
+    if (!dst->meta_buf)
         goto fail;
+    dst->tab_mvf       = src->tab_mvf;
+    dst->rpl           = src->rpl;
+    dst->rpl_slice_idx = src->rpl_slice_idx;
 
     dst->poc        = src->poc;
     dst->ctb_count  = src->ctb_count;
     dst->window     = src->window;
     dst->flags      = src->flags;
     dst->sequence   = src->sequence;
+    dst->decode_order = src->decode_order;
 
     return 0;
 fail:
@@ -3197,17 +3374,14 @@ fail:
 static int hevc_frame_start(HEVCContext *s)
 {
     HEVCLocalContext *lc = s->HEVClc;
-    int pic_size_in_ctb  = ((s->sps->width  >> s->sps->log2_min_cb_size) + 1) *
-                           ((s->sps->height >> s->sps->log2_min_cb_size) + 1);
-    int ret = 0;
-    AVFrame *cur_frame;
+    int ctb_count        = s->sps->ctb_width * s->sps->ctb_height;
+    int ret = 0, reorder, i;
     av_log(s->avctx, AV_LOG_DEBUG, "frame start %d\n", s->decoder_id);
 
 
-    memset(s->horizontal_bs, 0, s->bs_width * s->bs_height);
-    memset(s->vertical_bs,   0, s->bs_width * s->bs_height);
-    memset(s->cbf_luma,      0, s->sps->min_tb_width * s->sps->min_tb_height);
-    memset(s->tab_slice_address, -1, pic_size_in_ctb * sizeof(*s->tab_slice_address));
+    /* the deblocking tables are cleared CTB by CTB in hls_decode_neighbour(),
+     * only the slice map, read for the CTBs not decoded yet, is reset here */
+    memset(s->tab_slice_address, -1, ctb_count * sizeof(*s->tab_slice_address));
 #if PARALLEL_SLICE
     memset(s->decoded_rows, 0,s->sps->ctb_height);
 #endif
@@ -3219,7 +3393,7 @@ static int hevc_frame_start(HEVCContext *s)
 #ifdef SVC_EXTENSION
     if (s->nuh_layer_id) {
 #if ACTIVE_PU_UPSAMPLING
-        memset (s->is_upsampled, 0, s->sps->ctb_width * s->sps->ctb_height);
+        memset (s->is_upsampled, 0, 2 * s->sps->ctb_width * s->sps->ctb_height);
 #endif
         if (s->el_decoder_el_exist ){
             ff_thread_await_il_progress(s->avctx, s->poc_id, &s->avctx->BL_frame);
@@ -3246,8 +3420,17 @@ static int hevc_frame_start(HEVCContext *s)
 
     if (ret < 0)
         goto fail;
+    if (!(s->threads_type & FF_THREAD_FRAME))
+        ff_hevc_update_mem_usage(s);
     s->avctx->BL_frame = s->ref;
-    ret = ff_hevc_frame_rps(s);
+    if (s->irap_only && !s->nuh_layer_id) {
+        /* the IRAP pictures are intra coded and the pictures their RPS
+         * lists are never decoded, so only the older pictures are dropped */
+        for (i = 0; i < FF_ARRAY_ELEMS(s->DPB); i++)
+            if (&s->DPB[i] != s->ref)
+                ff_hevc_unref_frame(s, &s->DPB[i], HEVC_FRAME_FLAG_SHORT_REF | HEVC_FRAME_FLAG_LONG_REF);
+    } else
+        ret = ff_hevc_frame_rps(s);
     if (ret < 0) {
         av_log(s->avctx, AV_LOG_ERROR, "Error constructing the frame RPS. decoder_id %d \n", s->decoder_id);
         goto fail;
@@ -3257,8 +3440,7 @@ static int hevc_frame_start(HEVCContext *s)
     if (ret < 0)
         goto fail;
 
-    cur_frame = s->sps->sao_enabled ? s->sao_frame : s->frame;
-    cur_frame->pict_type = 3 - s->sh.slice_type;
+    s->frame->pict_type = 3 - s->sh.slice_type;
 
     if (!IS_IRAP(s))
         ff_hevc_bump_frame(s);
@@ -3268,6 +3450,15 @@ static int hevc_frame_start(HEVCContext *s)
     if (ret < 0)
         goto fail;
 
+    /* in low-latency mode, frame threads only buffer as many pictures as
+     * the reordering delays anyway */
+    reorder = s->sps->temporal_layer[s->sps->max_sub_layers - 1].num_reorder_pics;
+    s->pic_latency = reorder +
+                     ff_thread_limit_delay(s->avctx, s->low_latency ? reorder : INT_MAX);
+    /* with frame threads it is published by hevc_update_thread_context() */
+    if (!(s->threads_type & FF_THREAD_FRAME))
+        s->output_latency = s->pic_latency;
+
     ff_thread_finish_setup(s->avctx);
 
     return 0;
@@ -3366,6 +3557,10 @@ static int decode_nal_unit(HEVCContext *s, const uint8_t *nal, int length)
 
         if (ret < 0)
             return ret;
+        if (s->header_only) {
+            record_picture_header(s);
+            break;
+        }
         if(s->au_poc !=-1 && s->au_poc != s->poc) {
             av_log(s->avctx, AV_LOG_ERROR, "Receive different poc in one AU. \n");
             s->max_ra == INT_MAX;
@@ -3660,6 +3855,9 @@ static int decode_nal_unit_slice(AVCodecContext *avctxt, void *input_ctb_row, in
                 for(i = s1->slice_segment_addr[s->job]; i < s->sps->ctb_height*s->sps->ctb_width; i++)
                     s->tab_slice_address[i] = s1->slice_segment_addr[s->job];
             }
+            ret = alloc_local_scratch(s, s->HEVClc);
+            if (ret < 0)
+                goto fail;
             ctb_addr_ts = hls_decode_entry_slice(s);
 
 
@@ -3779,6 +3977,8 @@ int ff_hevc_extract_rbsp(HEVCContext *s, const uint8_t *src, int length,
         return length;
     }
 
+    if (nal->rbsp_buffer_size < length + FF_INPUT_BUFFER_PADDING_SIZE)
+        s->scratch_allocs++;
     av_fast_malloc(&nal->rbsp_buffer, &nal->rbsp_buffer_size,
                    length + FF_INPUT_BUFFER_PADDING_SIZE);
     if (!nal->rbsp_buffer)
@@ -3801,6 +4001,7 @@ int ff_hevc_extract_rbsp(HEVCContext *s, const uint8_t *src, int length,
 
                 s->skipped_bytes++;
                 if (s->skipped_bytes_pos_size < s->skipped_bytes) {
+                    s->scratch_allocs++;
                     s->skipped_bytes_pos_size *= 2;
                     av_reallocp_array(&s->skipped_bytes_pos,
                             s->skipped_bytes_pos_size,
@@ -3828,6 +4029,42 @@ nsc:
     return si;
 }
 
+/* size of an Annex B NAL unit, up to the next start code or the end of the data */
+static int find_nal_end(const uint8_t *buf, int length)
+{
+    int i;
+
+    for (i = 1; i + 1 < length; i += 2) {
+        if (buf[i])
+            continue;
+        if (!buf[i - 1] && buf[i + 1] <= 2)
+            return i - 1;
+        if (i + 2 < length && !buf[i + 1] && buf[i + 2] <= 2)
+            return i;
+    }
+    return length;
+}
+
+/* Filter on the NAL unit header while splitting the packet, so that the
+ * dropped units are never unescaped. Every layer decoder sees the same
+ * units, so they agree on the dropped pictures. */
+static int skip_nal_unit(HEVCContext *s, const uint8_t *buf, int length)
+{
+    int nal_unit_type, nuh_layer_id, temporal_id;
+
+    if (length < 2)
+        return 0;
+    nal_unit_type = (buf[0] >> 1) & 0x3f;
+    nuh_layer_id  = ((buf[0] & 0x01) << 5) | (buf[1] >> 3);
+    temporal_id   = (buf[1] & 0x07) - 1;
+
+    if (temporal_id > s->temporal_layer_id)
+        return 1;
+    if (s->irap_only && nal_unit_type < NAL_BLA_W_LP)
+        return 1;
+    return s->drop_non_ref && is_non_ref_pic(s, nal_unit_type, nuh_layer_id, temporal_id);
+}
+
 static int decode_nal_units(HEVCContext *s, const uint8_t *buf, int length)
 {
     int i,  consumed, ret = 0;
@@ -3888,9 +4125,18 @@ static int decode_nal_units(HEVCContext *s, const uint8_t *buf, int length)
         if (!s->is_nalff)
             extract_length = length;
 
+        if (skip_nal_unit(s, buf, extract_length)) {
+            int size = s->is_nalff ? extract_length : find_nal_end(buf, length);
+            buf    += size;
+            length -= size;
+            continue;
+        }
+
         if (s->nals_allocated < s->nb_nals + 1) {
-            int new_size = s->nals_allocated + 1;
+            int new_size = FFMAX(2 * s->nals_allocated, 16);
             HEVCNAL *tmp = av_realloc_array(s->nals, new_size, sizeof(*tmp));
+            int *skipped, *pos_size;
+            int **pos;
             if (!tmp) {
                 ret = AVERROR(ENOMEM);
                 goto fail;
@@ -3898,12 +4144,37 @@ static int decode_nal_units(HEVCContext *s, const uint8_t *buf, int length)
             s->nals = tmp;
             memset(s->nals + s->nals_allocated, 0,
                    (new_size - s->nals_allocated) * sizeof(*tmp));
-            av_reallocp_array(&s->skipped_bytes_nal, new_size, sizeof(*s->skipped_bytes_nal));
-            av_reallocp_array(&s->skipped_bytes_pos_size_nal, new_size, sizeof(*s->skipped_bytes_pos_size_nal));
-            av_reallocp_array(&s->skipped_bytes_pos_nal, new_size, sizeof(*s->skipped_bytes_pos_nal));
-            s->skipped_bytes_pos_size_nal[s->nals_allocated] = 1024; // initial buffer size
-            s->skipped_bytes_pos_nal[s->nals_allocated] = av_malloc_array(s->skipped_bytes_pos_size_nal[s->nals_allocated], sizeof(*s->skipped_bytes_pos));
+            /* on failure the arrays grown so far are kept, the first
+             * nals_allocated entries of each stay valid */
+            skipped = av_realloc_array(s->skipped_bytes_nal, new_size, sizeof(*skipped));
+            if (!skipped) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            s->skipped_bytes_nal = skipped;
+            pos_size = av_realloc_array(s->skipped_bytes_pos_size_nal, new_size, sizeof(*pos_size));
+            if (!pos_size) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            s->skipped_bytes_pos_size_nal = pos_size;
+            pos = av_realloc_array(s->skipped_bytes_pos_nal, new_size, sizeof(*pos));
+            if (!pos) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+            s->skipped_bytes_pos_nal = pos;
+            for (i = s->nals_allocated; i < new_size; i++) {
+                s->skipped_bytes_pos_size_nal[i] = 1024; // initial buffer size
+                s->skipped_bytes_pos_nal[i] = av_malloc_array(s->skipped_bytes_pos_size_nal[i], sizeof(*s->skipped_bytes_pos));
+                if (!s->skipped_bytes_pos_nal[i]) {
+                    s->nals_allocated = i;
+                    ret = AVERROR(ENOMEM);
+                    goto fail;
+                }
+            }
             s->nals_allocated = new_size;
+            s->scratch_allocs++;
         }
         s->skipped_bytes_pos_size = s->skipped_bytes_pos_size_nal[s->nb_nals];
         s->skipped_bytes_pos = s->skipped_bytes_pos_nal[s->nb_nals];
@@ -4142,6 +4413,22 @@ static int hevc_decode_frame(AVCodecContext *avctx, void *data, int *got_output,
     if (ret < 0)
         return ret;
 
+    if (s->header_only) {
+        AVHEVCPictureHeader *hdr = &s->pic_header;
+
+        if (hdr->nb_slice_segments && avctx->hevc_picture_header) {
+            hdr->pts               = avpkt->pts;
+            hdr->picture_structure = s->picture_struct;
+            hdr->has_md5           = s->is_md5;
+            if (s->is_md5)
+                memcpy(hdr->md5, s->md5, sizeof(hdr->md5));
+            avctx->hevc_picture_header(avctx, hdr);
+        }
+        hdr->nb_slice_segments = 0;
+        s->is_md5 = 0;
+        return avpkt->size;
+    }
+
     /* verify the SEI checksum */
     if (s->decode_checksum_sei && s->is_decoded) {
         AVFrame *frame = s->ref->frame;
@@ -4203,7 +4490,6 @@ static av_cold int hevc_decode_free(AVCodecContext *avctx)
 
     av_freep(&s->cabac_state);
 
-    av_frame_free(&s->tmp_frame);
     av_frame_free(&s->output_frame);
 
     for (i = 0; i < FF_ARRAY_ELEMS(s->DPB); i++) {
@@ -4217,12 +4503,21 @@ static av_cold int hevc_decode_free(AVCodecContext *avctx)
 
 
 
-    for (i = 0; i < FF_ARRAY_ELEMS(s->vps_list); i++)
+    for (i = 0; i < FF_ARRAY_ELEMS(s->vps_list); i++) {
         av_buffer_unref(&s->vps_list[i]);
-    for (i = 0; i < FF_ARRAY_ELEMS(s->sps_list); i++)
+        av_buffer_unref(&s->vps_rbsp[i]);
+    }
+    for (i = 0; i < FF_ARRAY_ELEMS(s->sps_list); i++) {
         av_buffer_unref(&s->sps_list[i]);
-    for (i = 0; i < FF_ARRAY_ELEMS(s->pps_list); i++)
+        av_buffer_unref(&s->sps_rbsp[i]);
+    }
+    for (i = 0; i < FF_ARRAY_ELEMS(s->pps_list); i++) {
         av_buffer_unref(&s->pps_list[i]);
+        av_buffer_unref(&s->pps_rbsp[i]);
+    }
+    av_buffer_pool_uninit(&s->vps_pool);
+    av_buffer_pool_uninit(&s->vps_base_pool);
+    av_buffer_pool_uninit(&s->sps_pool);
 
     av_freep(&s->sh.entry_point_offset); // TODO Free for each slice
     av_freep(&s->sh.offset);
@@ -4231,12 +4526,15 @@ static av_cold int hevc_decode_free(AVCodecContext *avctx)
     for (i = 1; i < s->threads_number; i++) {
         lc = s->HEVClcList[i];
         if (lc) {
+            free_local_scratch(lc);
             av_freep(&s->HEVClcList[i]);
             av_freep(&s->sList[i]);
         }
     }
     if (s->HEVClc == s->HEVClcList[0])
         s->HEVClc = NULL;
+    if (s->HEVClcList[0])
+        free_local_scratch(s->HEVClcList[0]);
     av_freep(&s->HEVClcList[0]);
 
     for (i = 0; i < s->nals_allocated; i++)
@@ -4268,11 +4566,6 @@ static av_cold int hevc_init_context(AVCodecContext *avctx)
     if (!s->cabac_state)
         goto fail;
      s->HEVClc->dbs_g = InitC();
-    s->tmp_frame = av_frame_alloc();
-    s->dynamic_alloc += sizeof(AVFrame); 
-    if (!s->tmp_frame)
-        goto fail;
-
     s->output_frame = av_frame_alloc();
     s->dynamic_alloc += sizeof(AVFrame); 
     if (!s->output_frame)
@@ -4321,6 +4614,15 @@ static av_cold int hevc_init_context(AVCodecContext *avctx)
         s->HEVClcList[i] = av_mallocz(sizeof(HEVCLocalContext));
         s->sList[i]->HEVClc = s->HEVClcList[i];
     }
+    /* the slice thread copies of the context are accounted as scratch */
+    s->mem_scratch = HEVC_CONTEXTS + s->threads_number * sizeof(HEVCLocalContext) +
+                     (s->threads_number - 1) * sizeof(HEVCContext);
+    /* the budget counts the scratch areas before their first slice */
+    s->mem_scratch_max = s->mem_scratch + s->threads_number * SCRATCH_SIZE;
+#ifdef SVC_EXTENSION
+    if (avctx->BL_avcontext)
+        s->mem_scratch_max += s->threads_number * SCRATCH_UP_SIZE;
+#endif
 
 #if 0
     printf("### %ld ### \n", s->dynamic_alloc );
@@ -4357,29 +4659,38 @@ static int hevc_update_thread_context(AVCodecContext *dst,
 
     for (i = 0; i < FF_ARRAY_ELEMS(s->vps_list); i++) {
         av_buffer_unref(&s->vps_list[i]);
+        av_buffer_unref(&s->vps_rbsp[i]);
         if (s0->vps_list[i]) {
             s->vps_list[i] = av_buffer_ref(s0->vps_list[i]);
             if (!s->vps_list[i])
                 return AVERROR(ENOMEM);
         }
+        if (s0->vps_rbsp[i])
+            s->vps_rbsp[i] = av_buffer_ref(s0->vps_rbsp[i]);
     }
 
     for (i = 0; i < FF_ARRAY_ELEMS(s->sps_list); i++) {
         av_buffer_unref(&s->sps_list[i]);
+        av_buffer_unref(&s->sps_rbsp[i]);
         if (s0->sps_list[i]) {
             s->sps_list[i] = av_buffer_ref(s0->sps_list[i]);
             if (!s->sps_list[i])
                 return AVERROR(ENOMEM);
         }
+        if (s0->sps_rbsp[i])
+            s->sps_rbsp[i] = av_buffer_ref(s0->sps_rbsp[i]);
     }
 
     for (i = 0; i < FF_ARRAY_ELEMS(s->pps_list); i++) {
         av_buffer_unref(&s->pps_list[i]);
+        av_buffer_unref(&s->pps_rbsp[i]);
         if (s0->pps_list[i]) {
             s->pps_list[i] = av_buffer_ref(s0->pps_list[i]);
             if (!s->pps_list[i])
                 return AVERROR(ENOMEM);
         }
+        if (s0->pps_rbsp[i])
+            s->pps_rbsp[i] = av_buffer_ref(s0->pps_rbsp[i]);
     }
 
     s->seq_decode           = s0->seq_decode;
@@ -4397,10 +4708,22 @@ static int hevc_update_thread_context(AVCodecContext *dst,
     s->quality_layer_id     = s0->quality_layer_id;
     s->decode_checksum_sei  = s0->decode_checksum_sei;
     s->poc_id               = s0->poc_id;
+    s->header_only          = s0->header_only;
+    s->prealloc_frames      = s0->prealloc_frames;
+    s->mem_budget           = s0->mem_budget;
+    s->low_latency          = s0->low_latency;
+    s->drop_non_ref         = s0->drop_non_ref;
+    s->irap_only            = s0->irap_only;
+    s->decode_order         = s0->decode_order;
 
     if (s->sps != s0->sps)
         ret = set_sps(s, s0->sps);
 
+    /* the frame threads never touch the shared usage struct: it is only
+     * updated here, in the user thread, from the DPB just copied */
+    ff_hevc_update_mem_usage(s);
+    s->user_ctx->output_latency = s0->pic_latency;
+
     if (s0->eos) {
         s->seq_decode = (s->seq_decode + 1) & 0xff;
         s->max_ra = INT_MAX;
@@ -4480,6 +4803,8 @@ static av_cold int hevc_decode_init(AVCodecContext *avctx)
     ff_init_cabac_states();
 
     avctx->internal->allocate_progress = 1;
+    avctx->internal->pool->hugepages   = s->hugepages;
+    s->user_ctx = s;
 
     ret = hevc_init_context(avctx);
     if (ret < 0)
@@ -4502,9 +4827,11 @@ static av_cold int hevc_decode_init(AVCodecContext *avctx)
 static av_cold int hevc_init_thread_copy(AVCodecContext *avctx)
 {
     HEVCContext *s = avctx->priv_data;
+    HEVCContext *user_ctx = s->user_ctx;
     int ret;
 
     memset(s, 0, sizeof(*s));
+    s->user_ctx = user_ctx;
 
     ret = hevc_init_context(avctx);
     if (ret < 0)
@@ -4537,11 +4864,29 @@ static const AVOption options[] = {
     { "strict-displaywin", "stricly apply default display window size", OFFSET(apply_defdispwin),
         AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, PAR },
     { "decoder-id", "set the decoder id", OFFSET(decoder_id),
-        AV_OPT_TYPE_INT, {.i64 = 0}, 0, 10, PAR },
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, MAX_LAYERS - 1, PAR },
     { "temporal-layer-id", "set the max temporal id", OFFSET(temporal_layer_id),
         AV_OPT_TYPE_INT, {.i64 = 0}, 0, 10, PAR },
     { "quality_layer_id", "set the max quality id", OFFSET(quality_layer_id),
         AV_OPT_TYPE_INT, {.i64 = 0}, 0, 10, PAR },
+    { "scratch-allocs", "number of scratch buffer allocations done while decoding", OFFSET(scratch_allocs),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, PAR | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "header-only", "only parse the headers and report them through hevc_picture_header", OFFSET(header_only),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, PAR },
+    { "prealloc-frames", "allocate all the DPB pictures when a SPS is activated", OFFSET(prealloc_frames),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, PAR },
+    { "hugepages", "use huge pages for the picture buffers", OFFSET(hugepages),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, PAR },
+    { "mem-budget", "reject the streams whose estimated footprint exceeds this many bytes, the NAL unit buffers excepted", OFFSET(mem_budget),
+        AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, PAR },
+    { "low-latency", "output the pictures as early as the SPS allows, limit the frame threads delay to the reordering", OFFSET(low_latency),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, PAR },
+    { "drop-non-ref", "drop the sub-layer non-reference pictures of the highest decoded sub-layer", OFFSET(drop_non_ref),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, 1, PAR },
+    { "irap-only", "only decode the IRAP pictures, 2 also skips the deblocking and SAO", OFFSET(irap_only),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, 2, PAR },
+    { "output-latency", "pictures of latency added by the reordering and the frame threads", OFFSET(output_latency),
+        AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, PAR | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { NULL },
 };
 
@@ -70,7 +70,6 @@
 
 
 
-#define TEST_MV_POC
 #define MAX_DPB_SIZE 16 // A.4.1
 #define MAX_REFS 16
 
@@ -129,6 +128,9 @@
 #define IS_BLA(s) ((s)->nal_unit_type == NAL_BLA_W_RADL || (s)->nal_unit_type == NAL_BLA_W_LP || \
                    (s)->nal_unit_type == NAL_BLA_N_LP)
 #define IS_IRAP(s) ((s)->nal_unit_type >= 16 && (s)->nal_unit_type <= 23)
+/* HandleCraAsBlaFlag: with only the IRAPs decoded, the previous Tid0 picture
+ * of a CRA is missing, so its POC is derived as for a BLA */
+#define IS_CRA_AS_BLA(s) ((s)->nal_unit_type == NAL_CRA_NUT && (s)->irap_only)
 
 enum ScalabilityType
 {
@@ -541,13 +543,18 @@ typedef struct HEVCVPS {
     uint8_t vps_poc_proportional_to_timing_flag;
     int vps_num_ticks_poc_diff_one; ///< vps_num_ticks_poc_diff_one_minus1 + 1
     int vps_num_hrd_parameters;
-    int m_layerIdIncludedFlag[MAX_VPS_LAYER_SETS_PLUS1][MAX_VPS_LAYER_ID_PLUS1];
+    uint8_t m_layerIdIncludedFlag[MAX_VPS_LAYER_SETS_PLUS1][MAX_VPS_LAYER_ID_PLUS1];
+#if DERIVE_LAYER_ID_LIST_VARIABLES
+    uint8_t m_layerSetLayerIdList[MAX_VPS_LAYER_SETS_PLUS1][MAX_VPS_LAYER_ID_PLUS1];
+    uint8_t m_numLayerInIdList[MAX_VPS_LAYER_SETS_PLUS1];
+#endif
     
     unsigned int       m_hrdOpSetIdx[10];
     unsigned int       m_cprmsPresentFlag;
-    
 
     int vps_extension_flag;
+    /* The fields below are only allocated when vps_extension_flag is set,
+     * the VPS is HEVC_VPS_BASE_SIZE bytes otherwise. */
 #ifdef VPS_EXTENSION
     int avc_base_layer_flag;
     int splitting_flag;
@@ -559,10 +566,6 @@ typedef struct HEVCVPS {
     int m_layerIdInVps[MAX_VPS_LAYER_ID_PLUS1];
 
     int dimension_id[MAX_VPS_LAYER_ID_PLUS1][MAX_VPS_NUM_SCALABILITY_TYPES];
-#if DERIVE_LAYER_ID_LIST_VARIABLES
-    int         m_layerSetLayerIdList[MAX_VPS_LAYER_SETS_PLUS1][MAX_VPS_LAYER_ID_PLUS1];
-    int         m_numLayerInIdList[MAX_VPS_LAYER_SETS_PLUS1];
-#endif
 
 #if VIEW_ID_RELATED_SIGNALING
     unsigned int         m_viewIdLenMinus1;
@@ -716,9 +719,14 @@ typedef struct HEVCVPS {
     unsigned int         m_vpsTransChar[16];
     unsigned int         m_vpsMatCoeff[16];
 #endif
-
 } HEVCVPS;
 
+#ifdef VPS_EXTENSION
+#define HEVC_VPS_BASE_SIZE offsetof(HEVCVPS, avc_base_layer_flag)
+#else
+#define HEVC_VPS_BASE_SIZE sizeof(HEVCVPS)
+#endif
+
 typedef struct ScalingList {
     /* This is a little wasteful, since sizeID 0 only needs 8 coeffs,
      * and size ID 3 only has 2 arrays, not 6. */
@@ -909,6 +917,7 @@ typedef struct HEVCPPS {
     int *min_tb_addr_zs;    ///< MinTbAddrZS
     int *min_tb_addr_zs_tab;///< MinTbAddrZS
 
+    AVBufferRef *sps_buf;   ///< SPS the tables above were derived from
 } HEVCPPS;
 
 typedef struct SliceHeader {
@@ -1031,12 +1040,7 @@ typedef struct Mv {
 
 typedef struct MvField {
     Mv mv[2];
-#ifdef TEST_MV_POC
-    int32_t poc[2];
-    uint32_t pred_flag;
-#else
     uint8_t pred_flag;
-#endif
     uint8_t ref_idx[2];
 } MvField;
 
@@ -1060,7 +1064,7 @@ typedef struct PredictionUnit {
 } PredictionUnit;
 
 typedef struct TransformUnit {
-    DECLARE_ALIGNED(32, int16_t, coeffs[2][MAX_TB_SIZE * MAX_TB_SIZE]);
+    int16_t *coeffs[2];     ///< MAX_TB_SIZE * MAX_TB_SIZE each, in HEVCLocalContext scratch
 
     int cu_qp_delta;
 
@@ -1095,16 +1099,19 @@ typedef struct HEVCFrame {
     ThreadFrame tf;
     MvField *tab_mvf;
     RefPicList *refPicList[MAX_SLICES_IN_FRAME];
-    RefPicListTab **rpl_tab;
+    RefPicListTab *rpl;        ///< one entry per slice
+    uint8_t *rpl_slice_idx;    ///< slice index of each CTB, in tile scan
     int ctb_count;
     int poc;
     struct HEVCFrame *collocated_ref;
 
     HEVCWindow window;
 
-    AVBufferRef *tab_mvf_buf;
-    AVBufferRef *rpl_tab_buf;
-    AVBufferRef *rpl_buf;
+    /**
+     * Per-picture metadata (tab_mvf, rpl, rpl_slice_idx) in a single
+     * block taken from HEVCContext.frame_meta_pool.
+     */
+    AVBufferRef *meta_buf;
 
     /**
      * A sequence counter, so that old frames are output first
@@ -1112,6 +1119,8 @@ typedef struct HEVCFrame {
      */
     uint16_t sequence;
 
+    int decode_order;          ///< HEVCContext.decode_order when the picture was started
+
     /**
      * A combination of HEVC_FRAME_FLAG_*
      */
@@ -1131,44 +1140,49 @@ typedef struct HEVCNAL {
     const uint8_t *data;
 } HEVCNAL;
 
+/* +7 is for subpixel interpolation, *2 for high bit depths */
+#define EDGE_EMU_BUFFER_SIZE ((MAX_PB_SIZE + 7) * EDGE_EMU_BUFFER_STRIDE * 2)
+
 typedef struct HEVCLocalContext {
-    GetBitContext       gb;
+    /* state touched for every syntax element comes first */
     CABACContext        cc;
-    TransformUnit       tu;
-    CodingTree          ct;
-    CodingUnit          cu;
-    PredictionUnit      pu;
-    NeighbourAvailable  na;
-
     uint8_t cabac_state[HEVC_CONTEXTS];
 
     uint8_t stat_coeff[4];
-
     uint8_t first_qp_group;
-
-
     int8_t qp_y;
     int8_t curr_qp_y;
-
-    int qPy_pred;
-
     uint8_t ctb_left_flag;
     uint8_t ctb_up_flag;
     uint8_t ctb_up_right_flag;
     uint8_t ctb_up_left_flag;
-    int     end_of_tiles_x;
-    int     end_of_tiles_y;
-    /* +7 is for subpixel interpolation, *2 for high bit depths */
-    DECLARE_ALIGNED(32, uint8_t, edge_emu_buffer)[(MAX_PB_SIZE + 7) * EDGE_EMU_BUFFER_STRIDE * 2];
-    DECLARE_ALIGNED(32, uint8_t, edge_emu_buffer2)[(MAX_PB_SIZE + 7) * EDGE_EMU_BUFFER_STRIDE * 2];
-    DECLARE_ALIGNED(32, int16_t, edge_emu_buffer_up_v[MAX_EDGE_BUFFER_SIZE]);
-
     uint8_t slice_or_tiles_left_boundary;
     uint8_t slice_or_tiles_up_boundary;
 
+    int qPy_pred;
+    int end_of_tiles_x;
+    int end_of_tiles_y;
     int ctb_tile_rs;
+
+    NeighbourAvailable  na;
+    CodingUnit          cu;
+    PredictionUnit      pu;
+    TransformUnit       tu;
+    CodingTree          ct;
+    GetBitContext       gb;
+
     Crypto_Handle       dbs_g;
-    
+
+    /**
+     * Scratch buffers, 64-byte aligned and allocated by
+     * alloc_local_scratch() before the first slice is decoded.
+     * edge_emu_buffer_up_v is only needed by enhancement layers.
+     */
+    uint8_t *scratch_buf;
+    uint8_t *edge_emu_buffer;
+    uint8_t *edge_emu_buffer2;
+    uint8_t *scratch_up_buf;
+    int16_t *edge_emu_buffer_up_v;
 } HEVCLocalContext;
 
 typedef struct HEVCContext {
@@ -1182,9 +1196,9 @@ typedef struct HEVCContext {
     uint8_t *cabac_state;
 
     AVFrame *frame;
-    AVFrame *sao_frame;
-    AVFrame *tmp_frame;
     AVFrame *output_frame;
+    uint8_t *sao_pixel_buffer_h[3]; ///< pre-SAO top and bottom rows of each CTB row
+    uint8_t *sao_pixel_buffer_v[3]; ///< pre-SAO left and right columns of each CTB column
 
     const HEVCVPS *vps;
     const HEVCSPS *sps;
@@ -1192,9 +1206,16 @@ typedef struct HEVCContext {
     AVBufferRef *vps_list[MAX_VPS_COUNT];
     AVBufferRef *sps_list[MAX_SPS_COUNT];
     AVBufferRef *pps_list[MAX_PPS_COUNT];
+    AVBufferPool *vps_pool;      ///< full size VPS buffers used while parsing
+    AVBufferPool *vps_base_pool; ///< VPS buffers without the extension fields
+    AVBufferPool *sps_pool;
+    AVBufferRef *vps_rbsp[MAX_VPS_COUNT]; ///< RBSP the stored VPS was parsed from, to detect repeats
+    AVBufferRef *sps_rbsp[MAX_SPS_COUNT];
+    AVBufferRef *pps_rbsp[MAX_PPS_COUNT];
 
-    AVBufferPool *tab_mvf_pool;
-    AVBufferPool *rpl_tab_pool;
+    AVBufferPool *frame_meta_pool;
+    int frame_meta_rpl_offset;  ///< offset of HEVCFrame.rpl in a meta_buf
+    int frame_meta_map_offset;  ///< offset of HEVCFrame.rpl_slice_idx in a meta_buf
 
     SAOParams *sao;
     DBParams *deblock;
@@ -1264,9 +1285,47 @@ typedef struct HEVCContext {
 
     const uint8_t *data;
 
+    ///< per-slice job arguments and return values of hls_slice_data(),
+    ///< sized from the SPS so that no allocation happens per slice
+    int *entry_arg;
+    int *entry_ret;
+
     HEVCNAL *nals;
     int nb_nals;
     int nals_allocated;
+
+    ///< number of scratch buffer (re)allocations done by the decoding
+    ///< process, it does not change once the decoder reached steady state
+    int scratch_allocs;
+
+    int header_only;                ///< parse the headers, skip the reconstruction
+    AVHEVCPictureHeader pic_header; ///< headers of the current picture in header-only mode
+
+    int prealloc_frames;            ///< fill the frame pool for the whole DPB at SPS activation
+    int hugepages;                  ///< back the frame pool with huge pages
+
+    /**
+     * Cap on the estimated footprint in bytes, 0 for none. It covers the
+     * pictures, the tables and the scratch areas of every local context,
+     * but not the NAL unit arrays and RBSP buffers, which follow the size
+     * of the packets.
+     */
+    int64_t mem_budget;
+    int64_t mem_tables;             ///< tables allocated at SPS activation
+    int64_t mem_scratch;            ///< local contexts and their scratch areas
+    int64_t mem_scratch_max;        ///< mem_scratch once every local context decoded a slice
+    int64_t mem_upsampling;         ///< SHVC inter-layer upsampling buffers
+    int64_t mem_picture;            ///< one picture buffer of the active SPS
+    int64_t mem_frame_meta;         ///< one pooled metadata block of the active SPS
+
+    int low_latency;                ///< output as early as the SPS allows, limit the frame threads delay
+    int output_latency;             ///< pictures of latency added by the output path, as seen by the user
+    int pic_latency;                ///< output_latency at the last picture this context started
+    struct HEVCContext *user_ctx;   ///< context whose options the user reads, shared with frame thread 0
+    int drop_non_ref;               ///< skip the sub-layer non-reference pictures, for trick play
+    int irap_only;                  ///< only decode the IRAP pictures, 2 for preview quality
+    uint8_t no_loop_filter;         ///< the current slice is neither deblocked nor SAO filtered
+    int decode_order;               ///< number of pictures started
     // type of the first VCL NAL of the current frame
     enum NALUnitType first_nal_type;
 
@@ -1290,6 +1349,8 @@ typedef struct HEVCContext {
     uint8_t         el_decoder_el_exist; // wheither the el exist or not at the el decoder
     uint8_t         el_decoder_bl_exist;
     uint8_t     *is_upsampled;
+    uint8_t     *is_mv_upsampled;   ///< CTBs of inter_layer_ref with an upscaled motion field, after is_upsampled
+    uint8_t     bl_aliased;         ///< inter_layer_ref references the samples of BL_frame
 #endif
     int temporal_layer_id;
     int decoder_id;
@@ -1438,6 +1499,17 @@ int ff_hevc_output_frame(HEVCContext *s, AVFrame *frame, int flush);
 
 void ff_hevc_unref_frame(HEVCContext *s, HEVCFrame *frame, int flags);
 
+/**
+ * Estimate the footprint of the decoder, all frame threads included, when
+ * nb_frames pictures are allocated.
+ */
+int64_t ff_hevc_mem_estimate(HEVCContext *s, int nb_frames);
+
+/**
+ * Update avctx->hevc_mem_usage, if set, from the state of the DPB.
+ */
+void ff_hevc_update_mem_usage(HEVCContext *s);
+
 void ff_hevc_set_neighbour_available(HEVCContext *s, int x0, int y0,
                                      int nPbW, int nPbH);
 void ff_hevc_luma_mv_merge_mode(HEVCContext *s, int x0, int y0,
@@ -1469,6 +1541,8 @@ void ff_hevc_hls_filters_slice( HEVCContext *s, int x_ctb, int y_ctb, int ctb_si
 void ff_hevc_hls_filter_slice(  HEVCContext *s, int x, int y, int ctb_size);
 #endif
 void ff_upsample_block(HEVCContext *s, HEVCFrame *ref0, int x0, int y0, int nPbW, int nPbH);
+void ff_hevc_await_bl_row(HEVCContext *s, int el_y);
+void ff_upsample_mv_block(HEVCContext *s, int x0, int y0);
 void ff_hevc_hls_residual_coding(HEVCContext *s, int x0, int y0,
                                  int log2_trafo_size, enum ScanType scan_idx,
                                  int c_idx
@@ -148,8 +148,8 @@ static int get_qPy(HEVCContext *s, int xC, int yC)
     return s->qp_y_tab[x + y * s->sps->min_cb_width];
 }
 
-static void copy_CTB(uint8_t *dst, uint8_t *src,
-                     int width, int height, int stride_dst, int stride_src)
+static void copy_CTB(uint8_t *dst, const uint8_t *src,
+                     int width, int height, ptrdiff_t stride_dst, ptrdiff_t stride_src)
 {
     int i;
 
@@ -160,13 +160,65 @@ static void copy_CTB(uint8_t *dst, uint8_t *src,
     }
 }
 
-static void restore_tqb_pixels(HEVCContext *s, int x0, int y0, int width, int height, int c_idx)
+static void copy_pixel(uint8_t *dst, const uint8_t *src, int pixel_shift)
+{
+    if (pixel_shift)
+        *(uint16_t *)dst = *(uint16_t *)src;
+    else
+        *dst = *src;
+}
+
+static void copy_vert(uint8_t *dst, const uint8_t *src,
+                      int pixel_shift, int height,
+                      ptrdiff_t stride_dst, ptrdiff_t stride_src)
+{
+    int i;
+
+    if (pixel_shift == 0) {
+        for (i = 0; i < height; i++) {
+            *dst = *src;
+            dst += stride_dst;
+            src += stride_src;
+        }
+    } else {
+        for (i = 0; i < height; i++) {
+            *(uint16_t *)dst = *(uint16_t *)src;
+            dst += stride_dst;
+            src += stride_src;
+        }
+    }
+}
+
+/* save the unfiltered border rows and columns of a CTB before SAO
+ * overwrites them, the neighbouring CTBs still need them */
+static void copy_CTB_to_hv(HEVCContext *s, const uint8_t *src,
+                           ptrdiff_t stride_src, int x, int y, int width, int height,
+                           int c_idx, int x_ctb, int y_ctb)
+{
+    int sh = s->sps->pixel_shift;
+    int w  = s->sps->width  >> s->sps->hshift[c_idx];
+    int h  = s->sps->height >> s->sps->vshift[c_idx];
+
+    /* copy horizontal edges */
+    memcpy(s->sao_pixel_buffer_h[c_idx] + (((2 * y_ctb) * w + x) << sh),
+           src, width << sh);
+    memcpy(s->sao_pixel_buffer_h[c_idx] + (((2 * y_ctb + 1) * w + x) << sh),
+           src + stride_src * (height - 1), width << sh);
+
+    /* copy vertical edges */
+    copy_vert(s->sao_pixel_buffer_v[c_idx] + (((2 * x_ctb) * h + y) << sh), src, sh, height, 1 << sh, stride_src);
+
+    copy_vert(s->sao_pixel_buffer_v[c_idx] + (((2 * x_ctb + 1) * h + y) << sh), src + ((width - 1) << sh), sh, height, 1 << sh, stride_src);
+}
+
+static void restore_tqb_pixels(HEVCContext *s,
+                               uint8_t *src1, const uint8_t *dst1,
+                               ptrdiff_t stride_src, ptrdiff_t stride_dst,
+                               int x0, int y0, int width, int height, int c_idx)
 {
     if ( s->pps->transquant_bypass_enable_flag ||
             (s->sps->pcm.loop_filter_disable_flag && s->sps->pcm_enabled_flag)) {
         int x, y;
-        ptrdiff_t stride_dst = s->sao_frame->linesize[c_idx];
-        ptrdiff_t stride_src = s->frame->linesize[c_idx];
         int min_pu_size  = 1 << s->sps->log2_min_pu_size;
         int hshift       = s->sps->hshift[c_idx];
         int vshift       = s->sps->vshift[c_idx];
@@ -174,13 +226,13 @@ static void restore_tqb_pixels(HEVCContext *s, int x0, int y0, int width, int he
         int y_min        = ((y0         ) >> s->sps->log2_min_pu_size);
         int x_max        = ((x0 + width ) >> s->sps->log2_min_pu_size);
         int y_max        = ((y0 + height) >> s->sps->log2_min_pu_size);
-        int len          = min_pu_size >> hshift;
+        int len          = (min_pu_size >> hshift) << s->sps->pixel_shift;
         for (y = y_min; y < y_max; y++) {
             for (x = x_min; x < x_max; x++) {
                 if (s->is_pcm[y * s->sps->min_pu_width + x]) {
                     int n;
-                    uint8_t *src = &s->frame->data[c_idx][    ((y << s->sps->log2_min_pu_size) >> vshift) * stride_src + (((x << s->sps->log2_min_pu_size) >> hshift) << s->sps->pixel_shift)];
-                    uint8_t *dst = &s->sao_frame->data[c_idx][((y << s->sps->log2_min_pu_size) >> vshift) * stride_dst + (((x << s->sps->log2_min_pu_size) >> hshift) << s->sps->pixel_shift)];
+                    uint8_t *src = src1 + (((y << s->sps->log2_min_pu_size) - y0) >> vshift) * stride_src + ((((x << s->sps->log2_min_pu_size) - x0) >> hshift) << s->sps->pixel_shift);
+                    const uint8_t *dst = dst1 + (((y << s->sps->log2_min_pu_size) - y0) >> vshift) * stride_dst + ((((x << s->sps->log2_min_pu_size) - x0) >> hshift) << s->sps->pixel_shift);
                     for (n = 0; n < (min_pu_size >> vshift); n++) {
                         memcpy(src, dst, len);
                         src += stride_src;
@@ -194,6 +246,10 @@ static void restore_tqb_pixels(HEVCContext *s, int x0, int y0, int width, int he
 
 #define CTB(tab, x, y) ((tab)[(y) * s->sps->ctb_width + (x)])
 
+/* stride of the per-thread CTB scratch area used as SAO input, wide enough
+ * for a 64 pixel 16-bit CTB plus its left/right neighbours and SIMD overreads */
+#define SAO_STRIDE (2 * MAX_PB_SIZE + FF_INPUT_BUFFER_PADDING_SIZE)
+
 static void sao_filter_CTB(HEVCContext *s, int x, int y)
 {
     int c_idx;
@@ -215,6 +271,11 @@ static void sao_filter_CTB(HEVCContext *s, int x, int y)
     uint8_t right_tile_edge  = 0;
     uint8_t up_tile_edge     = 0;
     uint8_t bottom_tile_edge = 0;
+    uint8_t restore_tqb      = s->pps->transquant_bypass_enable_flag ||
+                               (s->sps->pcm.loop_filter_disable_flag && s->sps->pcm_enabled_flag);
+
+    if (s->no_loop_filter)
+        return;
 
     edges[0]   = x_ctb == 0;
     edges[1]   = y_ctb == 0;
@@ -255,56 +316,136 @@ static void sao_filter_CTB(HEVCContext *s, int x, int y)
     for (c_idx = 0; c_idx < (s->sps->chroma_array_type ? 3 : 1); c_idx++) {
         int x0       = x >> s->sps->hshift[c_idx];
         int y0       = y >> s->sps->vshift[c_idx];
-        int stride_src = s->frame->linesize[c_idx];
-        int stride_dst = s->sao_frame->linesize[c_idx];
+        ptrdiff_t stride_src = s->frame->linesize[c_idx];
         int ctb_size_h = (1 << (s->sps->log2_ctb_size)) >> s->sps->hshift[c_idx];
         int ctb_size_v = (1 << (s->sps->log2_ctb_size)) >> s->sps->vshift[c_idx];
         int width    = FFMIN(ctb_size_h, (s->sps->width  >> s->sps->hshift[c_idx]) - x0);
         int height   = FFMIN(ctb_size_v, (s->sps->height >> s->sps->vshift[c_idx]) - y0);
-        uint8_t *src = &s->frame->data[c_idx][y0 * stride_src + (x0 << s->sps->pixel_shift)];
-        uint8_t *dst = &s->sao_frame->data[c_idx][y0 * stride_dst + (x0 << s->sps->pixel_shift)];
+        int tab      = sao->type_idx[c_idx];
+        int sh       = s->sps->pixel_shift;
+        uint8_t *src = &s->frame->data[c_idx][y0 * stride_src + (x0 << sh)];
 
-        switch (sao->type_idx[c_idx]) {
+        switch (tab) {
         case SAO_BAND:
-            copy_CTB(dst, src, width << s->sps->pixel_shift, height, stride_dst, stride_src);
-            s->hevcdsp.sao_band_filter(src, dst,
-                                       stride_src, stride_dst,
-                                       sao,
-                                       edges, width,
-                                       height, c_idx);
-            restore_tqb_pixels(s, x, y, width, height, c_idx);
+            copy_CTB_to_hv(s, src, stride_src, x0, y0, width, height, c_idx,
+                           x_ctb, y_ctb);
+            if (restore_tqb) {
+                ptrdiff_t stride_dst = SAO_STRIDE;
+                uint8_t *dst = s->HEVClc->edge_emu_buffer + stride_dst + FF_INPUT_BUFFER_PADDING_SIZE;
+
+                copy_CTB(dst, src, width << sh, height, stride_dst, stride_src);
+                s->hevcdsp.sao_band_filter(src, dst,
+                                           stride_src, stride_dst,
+                                           sao,
+                                           edges, width,
+                                           height, c_idx);
+                restore_tqb_pixels(s, src, dst, stride_src, stride_dst,
+                                   x, y, width, height, c_idx);
+            } else {
+                s->hevcdsp.sao_band_filter(src, src,
+                                           stride_src, stride_src,
+                                           sao,
+                                           edges, width,
+                                           height, c_idx);
+            }
             sao->type_idx[c_idx] = SAO_APPLIED;
             break;
         case SAO_EDGE:
         {
-            uint8_t left_pixels = !edges[0] && (CTB(s->sao, x_ctb-1, y_ctb).type_idx[c_idx] != SAO_APPLIED);
-            if (!edges[1]) {
-                uint8_t top_left  = !edges[0] && (CTB(s->sao, x_ctb-1, y_ctb-1).type_idx[c_idx] != SAO_APPLIED);
-                uint8_t top_right = !edges[2] && (CTB(s->sao, x_ctb+1, y_ctb-1).type_idx[c_idx] != SAO_APPLIED);
-                if (CTB(s->sao, x_ctb  , y_ctb-1).type_idx[c_idx] == 0)
-                    memcpy( dst - stride_dst - (top_left << s->sps->pixel_shift),
-                            src - stride_src - (top_left << s->sps->pixel_shift),
-                            (top_left + width + top_right) << s->sps->pixel_shift);
-                else {
-                    if (top_left)
-                        memcpy( dst - stride_dst - (1 << s->sps->pixel_shift),
-                                src - stride_src - (1 << s->sps->pixel_shift),
-                                1 << s->sps->pixel_shift);
-                    if(top_right)
-                        memcpy( dst - stride_dst + (width << s->sps->pixel_shift),
-                                src - stride_src + (width << s->sps->pixel_shift),
-                                1 << s->sps->pixel_shift);
+            int w = s->sps->width  >> s->sps->hshift[c_idx];
+            int h = s->sps->height >> s->sps->vshift[c_idx];
+            int left_edge   = edges[0];
+            int top_edge    = edges[1];
+            int right_edge  = edges[2];
+            int bottom_edge = edges[3];
+            ptrdiff_t stride_dst = SAO_STRIDE;
+            uint8_t *dst = s->HEVClc->edge_emu_buffer + stride_dst + FF_INPUT_BUFFER_PADDING_SIZE;
+            int left_pixels, right_pixels;
+
+            /* the neighbours that were already filtered are read back from
+             * the line buffers, the others are still unfiltered in the frame */
+            if (!top_edge) {
+                int left         = 1 - left_edge;
+                int right        = 1 - right_edge;
+                const uint8_t *src1[2];
+                uint8_t *dst1;
+                int src_idx, pos;
+
+                dst1 = dst - stride_dst - (left << sh);
+                src1[0] = src - stride_src - (left << sh);
+                src1[1] = s->sao_pixel_buffer_h[c_idx] + (((2 * y_ctb - 1) * w + x0 - left) << sh);
+                pos = 0;
+                if (left) {
+                    src_idx = (CTB(s->sao, x_ctb-1, y_ctb-1).type_idx[c_idx] ==
+                               SAO_APPLIED);
+                    copy_pixel(dst1, src1[src_idx], sh);
+                    pos += (1 << sh);
+                }
+                src_idx = (CTB(s->sao, x_ctb, y_ctb-1).type_idx[c_idx] ==
+                           SAO_APPLIED);
+                memcpy(dst1 + pos, src1[src_idx] + pos, width << sh);
+                if (right) {
+                    pos += width << sh;
+                    src_idx = (CTB(s->sao, x_ctb+1, y_ctb-1).type_idx[c_idx] ==
+                               SAO_APPLIED);
+                    copy_pixel(dst1 + pos, src1[src_idx] + pos, sh);
                 }
             }
-            if (!edges[3]) {                                                                // bottom and bottom right
-                uint8_t bottom_left = !edges[0] && (CTB(s->sao, x_ctb-1, y_ctb+1).type_idx[c_idx] != SAO_APPLIED);
-                memcpy( dst + height * stride_dst - (bottom_left << s->sps->pixel_shift),
-                        src + height * stride_src - (bottom_left << s->sps->pixel_shift),
-                        (width + 1 + bottom_left) << s->sps->pixel_shift);
+            if (!bottom_edge) {
+                int left         = 1 - left_edge;
+                int right        = 1 - right_edge;
+                const uint8_t *src1[2];
+                uint8_t *dst1;
+                int src_idx, pos;
+
+                dst1 = dst + height * stride_dst - (left << sh);
+                src1[0] = src + height * stride_src - (left << sh);
+                src1[1] = s->sao_pixel_buffer_h[c_idx] + (((2 * y_ctb + 2) * w + x0 - left) << sh);
+                pos = 0;
+                if (left) {
+                    src_idx = (CTB(s->sao, x_ctb-1, y_ctb+1).type_idx[c_idx] ==
+                               SAO_APPLIED);
+                    copy_pixel(dst1, src1[src_idx], sh);
+                    pos += (1 << sh);
+                }
+                src_idx = (CTB(s->sao, x_ctb, y_ctb+1).type_idx[c_idx] ==
+                           SAO_APPLIED);
+                memcpy(dst1 + pos, src1[src_idx] + pos, width << sh);
+                if (right) {
+                    pos += width << sh;
+                    src_idx = (CTB(s->sao, x_ctb+1, y_ctb+1).type_idx[c_idx] ==
+                               SAO_APPLIED);
+                    copy_pixel(dst1 + pos, src1[src_idx] + pos, sh);
+                }
             }
-            copy_CTB(dst - (left_pixels << s->sps->pixel_shift),
-                     src - (left_pixels << s->sps->pixel_shift),
-                     (width + 1 + left_pixels) << s->sps->pixel_shift, height, stride_dst, stride_src);
+            left_pixels  = 0;
+            right_pixels = 0;
+            if (!left_edge) {
+                if (CTB(s->sao, x_ctb-1, y_ctb).type_idx[c_idx] == SAO_APPLIED) {
+                    copy_vert(dst - (1 << sh),
+                              s->sao_pixel_buffer_v[c_idx] + (((2 * x_ctb - 1) * h + y0) << sh),
+                              sh, height, stride_dst, 1 << sh);
+                } else {
+                    left_pixels = 1;
+                }
+            }
+            if (!right_edge) {
+                if (CTB(s->sao, x_ctb+1, y_ctb).type_idx[c_idx] == SAO_APPLIED) {
+                    copy_vert(dst + (width << sh),
+                              s->sao_pixel_buffer_v[c_idx] + (((2 * x_ctb + 2) * h + y0) << sh),
+                              sh, height, stride_dst, 1 << sh);
+                } else {
+                    right_pixels = 1;
+                }
+            }
+
+            copy_CTB(dst - (left_pixels << sh),
+                     src - (left_pixels << sh),
+                     (width + left_pixels + right_pixels) << sh,
+                     height, stride_dst, stride_src);
+
+            copy_CTB_to_hv(s, src, stride_src, x0, y0, width, height, c_idx,
+                           x_ctb, y_ctb);
             s->hevcdsp.sao_edge_filter[restore](src, dst,
                                                 stride_src, stride_dst,
                                                 sao,
@@ -313,7 +454,8 @@ static void sao_filter_CTB(HEVCContext *s, int x, int y)
                                                 vert_edge,
                                                 horiz_edge,
                                                 diag_edge);
-            restore_tqb_pixels(s, x, y, width, height, c_idx);
+            restore_tqb_pixels(s, src, dst, stride_src, stride_dst,
+                               x, y, width, height, c_idx);
             sao->type_idx[c_idx] = SAO_APPLIED;
             break;
         }
@@ -364,6 +506,9 @@ static void deblocking_filter_CTB(HEVCContext *s, int x0, int y0)
                 s->sps->pcm.loop_filter_disable_flag) ||
                s->pps->transquant_bypass_enable_flag;
 
+    if (s->no_loop_filter)
+        return;
+
     if (x0) {
         left_tc_offset   = s->deblock[ctb - 1].tc_offset;
         left_beta_offset = s->deblock[ctb - 1].beta_offset;
@@ -580,132 +725,13 @@ static void deblocking_filter_CTB(HEVCContext *s, int x0, int y0)
     }
 }
 
-#ifdef TEST_MV_POC
-static int boundary_strength(HEVCContext *s, MvField *curr, MvField *neigh)
-{
-#if HAVE_SSE42
-    {
-        __m128i x0, x1, x2, x3;
-        x0 = _mm_loadu_si128((__m128i *) neigh);
-        x1 = _mm_loadu_si128((__m128i *) curr);
-        x2 = _mm_loadl_epi64((__m128i *) &(neigh->pred_flag));
-        x3 = _mm_loadl_epi64((__m128i *) &(curr->pred_flag));
-        x0 = _mm_cmpeq_epi64 (x0, x1);
-        x2 = _mm_cmpeq_epi32 (x2, x3);
-
-        if (_mm_test_all_ones(x0) && _mm_test_all_ones(x2))
-            return 0;
-    }
-#else
-    if ( memcmp(curr, neigh, sizeof(MvField)) == 0)
-        return 0;
-#endif
-    if (curr->pred_flag == PF_BI &&  neigh->pred_flag == PF_BI) {
-        // same L0 and L1
-        if (curr->poc[0] == neigh->poc[0]  &&
-            curr->poc[0] == curr->poc[1] &&
-            neigh->poc[0] == neigh->poc[1]) {
-#if HAVE_SSE42
-            __m128i x0, x1, x2;
-            x0 = _mm_loadl_epi64((__m128i *) neigh);
-            x1 = _mm_loadl_epi64((__m128i *) curr);
-            x2 =  _mm_shufflelo_epi16(x0, 0x4E);
-            x0 = _mm_sub_epi16(x0, x1);
-            x2 = _mm_sub_epi16(x2, x1);
-            x1 = _mm_set1_epi16(4);
-            x0 = _mm_abs_epi16(x0);
-            x2 = _mm_abs_epi16(x2);
-            x0 = _mm_cmplt_epi16(x0, x1);
-            x2 = _mm_cmplt_epi16(x2, x1);
-            return !(_mm_test_all_ones(x0) || _mm_test_all_ones(x2));
-#else
-            if ((FFABS(neigh->mv[0].x - curr->mv[0].x) >= 4 || FFABS(neigh->mv[0].y - curr->mv[0].y) >= 4 ||
-                 FFABS(neigh->mv[1].x - curr->mv[1].x) >= 4 || FFABS(neigh->mv[1].y - curr->mv[1].y) >= 4) &&
-                (FFABS(neigh->mv[1].x - curr->mv[0].x) >= 4 || FFABS(neigh->mv[1].y - curr->mv[0].y) >= 4 ||
-                 FFABS(neigh->mv[0].x - curr->mv[1].x) >= 4 || FFABS(neigh->mv[0].y - curr->mv[1].y) >= 4))
-                return 1;
-            else
-                return 0;
-#endif
-        } else if (neigh->poc[0] == curr->poc[0] &&
-                   neigh->poc[1] == curr->poc[1]) {
-#if HAVE_SSE42
-            __m128i x0, x1;
-            x0 = _mm_loadl_epi64((__m128i *) neigh);
-            x1 = _mm_loadl_epi64((__m128i *) curr);
-            x0 = _mm_sub_epi16(x0, x1);
-            x1 = _mm_set1_epi16(4);
-            x0 = _mm_abs_epi16(x0);
-            x0 = _mm_cmplt_epi16(x0, x1);
-            return !(_mm_test_all_ones(x0));
-#else
-            if (FFABS(neigh->mv[0].x - curr->mv[0].x) >= 4 || FFABS(neigh->mv[0].y - curr->mv[0].y) >= 4 ||
-                FFABS(neigh->mv[1].x - curr->mv[1].x) >= 4 || FFABS(neigh->mv[1].y - curr->mv[1].y) >= 4)
-                return 1;
-            else
-                return 0;
-#endif
-        } else if (neigh->poc[1] == curr->poc[0] &&
-                   neigh->poc[0] == curr->poc[1]) {
-#if HAVE_SSE42
-            __m128i x0, x1, x2;
-            x0 = _mm_loadl_epi64((__m128i *) neigh);
-            x1 = _mm_loadl_epi64((__m128i *) curr);
-            x2 = _mm_shufflelo_epi16(x0, 0x4E);
-            x2 = _mm_sub_epi16(x2, x1);
-            x1 = _mm_set1_epi16(4);
-            x2 = _mm_abs_epi16(x2);
-            x2 = _mm_cmplt_epi16(x2, x1);
-            return !(_mm_test_all_ones(x2));
-#else
-            if (FFABS(neigh->mv[1].x - curr->mv[0].x) >= 4 || FFABS(neigh->mv[1].y - curr->mv[0].y) >= 4 ||
-                FFABS(neigh->mv[0].x - curr->mv[1].x) >= 4 || FFABS(neigh->mv[0].y - curr->mv[1].y) >= 4)
-                return 1;
-            else
-                return 0;
-#endif
-        } else {
-            return 1;
-        }
-    } else if ((curr->pred_flag != PF_BI) && (neigh->pred_flag != PF_BI)){ // 1 MV
-        Mv A, B;
-        int ref_A, ref_B;
-
-        if (curr->pred_flag & 1) {
-            A     = curr->mv[0];
-            ref_A = curr->poc[0];
-        } else {
-            A     = curr->mv[1];
-            ref_A = curr->poc[1];
-        }
-
-        if (neigh->pred_flag & 1) {
-            B     = neigh->mv[0];
-            ref_B = neigh->poc[0];
-        } else {
-            B     = neigh->mv[1];
-            ref_B = neigh->poc[1];
-        }
-
-        if (ref_A == ref_B) {
-            if (FFABS(A.x - B.x) >= 4 || FFABS(A.y - B.y) >= 4)
-                return 1;
-            else
-                return 0;
-        } else
-            return 1;
-    }
-
-    return 1;
-}
-#else
-static int boundary_strength(HEVCContext *s, MvField *curr, MvField *neigh,
-                             RefPicList *neigh_refPicList)
+static int boundary_strength(HEVCContext *s, MvField *curr, RefPicList *refPicList,
+                             MvField *neigh, RefPicList *neigh_refPicList)
 {
     if (curr->pred_flag == PF_BI &&  neigh->pred_flag == PF_BI) {
         // same L0 and L1
-        if (s->ref->refPicList[0].list[curr->ref_idx[0]] == neigh_refPicList[0].list[neigh->ref_idx[0]]  &&
-            s->ref->refPicList[0].list[curr->ref_idx[0]] == s->ref->refPicList[1].list[curr->ref_idx[1]] &&
+        if (refPicList[0].list[curr->ref_idx[0]] == neigh_refPicList[0].list[neigh->ref_idx[0]]  &&
+            refPicList[0].list[curr->ref_idx[0]] == refPicList[1].list[curr->ref_idx[1]] &&
             neigh_refPicList[0].list[neigh->ref_idx[0]] == neigh_refPicList[1].list[neigh->ref_idx[1]]) {
 #if HAVE_SSE42
             __m128i x0, x1, x2;
@@ -729,8 +755,8 @@ static int boundary_strength(HEVCContext *s, MvField *curr, MvField *neigh,
             else
                 return 0;
 #endif
-        } else if (neigh_refPicList[0].list[neigh->ref_idx[0]] == s->ref->refPicList[0].list[curr->ref_idx[0]] &&
-                   neigh_refPicList[1].list[neigh->ref_idx[1]] == s->ref->refPicList[1].list[curr->ref_idx[1]]) {
+        } else if (neigh_refPicList[0].list[neigh->ref_idx[0]] == refPicList[0].list[curr->ref_idx[0]] &&
+                   neigh_refPicList[1].list[neigh->ref_idx[1]] == refPicList[1].list[curr->ref_idx[1]]) {
 #if HAVE_SSE42
             __m128i x0, x1;
             x0 = _mm_loadl_epi64((__m128i *) neigh);
@@ -747,8 +773,8 @@ static int boundary_strength(HEVCContext *s, MvField *curr, MvField *neigh,
             else
                 return 0;
 #endif
-        } else if (neigh_refPicList[1].list[neigh->ref_idx[1]] == s->ref->refPicList[0].list[curr->ref_idx[0]] &&
-                   neigh_refPicList[0].list[neigh->ref_idx[0]] == s->ref->refPicList[1].list[curr->ref_idx[1]]) {
+        } else if (neigh_refPicList[1].list[neigh->ref_idx[1]] == refPicList[0].list[curr->ref_idx[0]] &&
+                   neigh_refPicList[0].list[neigh->ref_idx[0]] == refPicList[1].list[curr->ref_idx[1]]) {
 #if HAVE_SSE42
             __m128i x0, x1, x2;
             x0 = _mm_loadl_epi64((__m128i *) neigh);
@@ -775,10 +801,10 @@ static int boundary_strength(HEVCContext *s, MvField *curr, MvField *neigh,
 
         if (curr->pred_flag & 1) {
             A     = curr->mv[0];
-            ref_A = s->ref->refPicList[0].list[curr->ref_idx[0]];
+            ref_A = refPicList[0].list[curr->ref_idx[0]];
         } else {
             A     = curr->mv[1];
-            ref_A = s->ref->refPicList[1].list[curr->ref_idx[1]];
+            ref_A = refPicList[1].list[curr->ref_idx[1]];
         }
 
         if (neigh->pred_flag & 1) {
@@ -800,7 +826,6 @@ static int boundary_strength(HEVCContext *s, MvField *curr, MvField *neigh,
 
     return 1;
 }
-#endif
 
 void ff_hevc_deblocking_boundary_strengths(HEVCContext *s, int x0, int y0,
                                            int log2_trafo_size)
@@ -813,6 +838,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCContext *s, int x0, int y0,
     int min_tu_width     = s->sps->min_tb_width;
     int is_intra = tab_mvf[(y0 >> log2_min_pu_size) * min_pu_width +
                            (x0 >> log2_min_pu_size)].pred_flag == PF_INTRA;
+    RefPicList *curr_refPicList = ff_hevc_get_ref_list(s, s->ref, x0, y0);
     int i, j, bs;
 
     if (y0 > 0 && (y0 & 7) == 0) {
@@ -826,10 +852,8 @@ void ff_hevc_deblocking_boundary_strengths(HEVCContext *s, int x0, int y0,
             int yq_pu =  y0      >> log2_min_pu_size;
             int yp_tu = (y0 - 1) >> log2_min_tu_size;
             int yq_tu =  y0      >> log2_min_tu_size;
-#ifndef TEST_MV_POC
             RefPicList *top_refPicList = ff_hevc_get_ref_list(s, s->ref,
                                                               x0, y0 - 1);
-#endif
             for (i = 0; i < (1 << log2_trafo_size); i += 4) {
                 int x_pu = (x0 + i) >> log2_min_pu_size;
                 int x_tu = (x0 + i) >> log2_min_tu_size;
@@ -843,11 +867,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCContext *s, int x0, int y0,
                 else if (curr_cbf_luma || top_cbf_luma)
                     bs = 1;
                 else
-#ifdef TEST_MV_POC
-                    bs = boundary_strength(s, curr, top);
-#else
-                    bs = boundary_strength(s, curr, top, top_refPicList);
-#endif
+                    bs = boundary_strength(s, curr, curr_refPicList, top, top_refPicList);
                 s->horizontal_bs[((x0 + i) + y0 * s->bs_width) >> 2] = bs;
             }
         }
@@ -865,10 +885,8 @@ void ff_hevc_deblocking_boundary_strengths(HEVCContext *s, int x0, int y0,
             int xq_pu =  x0      >> log2_min_pu_size;
             int xp_tu = (x0 - 1) >> log2_min_tu_size;
             int xq_tu =  x0      >> log2_min_tu_size;
-#ifndef TEST_MV_POC
             RefPicList *left_refPicList = ff_hevc_get_ref_list(s, s->ref,
                                                                x0 - 1, y0);
-#endif
             for (i = 0; i < (1 << log2_trafo_size); i += 4) {
                 int y_pu      = (y0 + i) >> log2_min_pu_size;
                 int y_tu      = (y0 + i) >> log2_min_tu_size;
@@ -882,22 +900,14 @@ void ff_hevc_deblocking_boundary_strengths(HEVCContext *s, int x0, int y0,
                 else if (curr_cbf_luma || left_cbf_luma)
                     bs = 1;
                 else
-#ifdef TEST_MV_POC
-                    bs = boundary_strength(s, curr, left);
-#else
-                    bs = boundary_strength(s, curr, left, left_refPicList);
-#endif
+                    bs = boundary_strength(s, curr, curr_refPicList, left, left_refPicList);
                 s->vertical_bs[(x0 + (y0 + i) * s->bs_width) >> 2] = bs;
             }
         }
     }
 
     if (log2_trafo_size > log2_min_pu_size && !is_intra) {
-#ifndef TEST_MV_POC
-        RefPicList *refPicList = ff_hevc_get_ref_list(s, s->ref,
-                                                           x0,
-                                                           y0);
-#endif
+        RefPicList *refPicList = curr_refPicList;
         // bs for TU internal horizontal PU boundaries
         for (i = 0; i < (1 << log2_trafo_size); i += 4) {
             int x_pu  = (x0 + i) >> log2_min_pu_size;
@@ -908,11 +918,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCContext *s, int x0, int y0,
                 int yq_pu = (y0 + j)     >> log2_min_pu_size;
                 MvField *curr = &tab_mvf[yq_pu * min_pu_width + x_pu];
 
-#ifdef TEST_MV_POC
-                bs = boundary_strength(s, curr, top);
-#else
-                bs = boundary_strength(s, curr, top, refPicList);
-#endif
+                bs = boundary_strength(s, curr, refPicList, top, refPicList);
                 s->horizontal_bs[((x0 + i) + (y0 + j) * s->bs_width) >> 2] = bs;
                 top = curr;
             }
@@ -928,11 +934,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCContext *s, int x0, int y0,
                 int xq_pu = (x0 + i)     >> log2_min_pu_size;
                 MvField *curr = &tab_mvf[y_pu * min_pu_width + xq_pu];
 
-#ifdef TEST_MV_POC
-                bs = boundary_strength(s, curr, left);
-#else
-                bs = boundary_strength(s, curr, left, refPicList);
-#endif
+                bs = boundary_strength(s, curr, refPicList, left, refPicList);
                 s->vertical_bs[((x0 + i) + (y0 + j) * s->bs_width) >> 2] = bs;
                 left = curr;
             }
@@ -959,19 +961,14 @@ void ff_hevc_deblocking_boundary_strengths_h(HEVCContext *s, int x0, int y0, int
         MvField *curr = &tab_mvf[yq_pu * pic_width_in_min_pu + x_pu];
         uint8_t top_cbf_luma  = s->cbf_luma[yp_tu * pic_width_in_min_tu + x_tu];
         uint8_t curr_cbf_luma = s->cbf_luma[yq_tu * pic_width_in_min_tu + x_tu];
-#ifndef TEST_MV_POC
-        RefPicList* top_refPicList = ff_hevc_get_ref_list(s, s->ref, x0, y0 - 1);
-#endif
+        RefPicList* top_refPicList  = ff_hevc_get_ref_list(s, s->ref, x0, y0 - 1);
+        RefPicList* curr_refPicList = ff_hevc_get_ref_list(s, s->ref, x0, y0);
         if (curr->pred_flag == PF_INTRA || top->pred_flag == PF_INTRA)
             bs = 2;
         else if (curr_cbf_luma || top_cbf_luma)
             bs = 1;
         else
-#ifdef TEST_MV_POC
-                bs = boundary_strength(s, curr, top);
-#else
-                bs = boundary_strength(s, curr, top, top_refPicList);
-#endif
+                bs = boundary_strength(s, curr, curr_refPicList, top, top_refPicList);
         if ((slice_up_boundary & 1) && (y0 % (1 << s->sps->log2_ctb_size)) == 0)
             bs = 0;
         if (s->sh.disable_deblocking_filter_flag == 1)
@@ -1000,19 +997,14 @@ void ff_hevc_deblocking_boundary_strengths_v(HEVCContext *s, int x0, int y0, int
         MvField *curr = &tab_mvf[y_pu * pic_width_in_min_pu + xq_pu];
         uint8_t left_cbf_luma = s->cbf_luma[y_tu * pic_width_in_min_tu + xp_tu];
         uint8_t curr_cbf_luma = s->cbf_luma[y_tu * pic_width_in_min_tu + xq_tu];
-#ifndef TEST_MV_POC
         RefPicList* left_refPicList = ff_hevc_get_ref_list(s, s->ref, x0 - 1, y0);
-#endif
+        RefPicList* curr_refPicList = ff_hevc_get_ref_list(s, s->ref, x0, y0);
         if (curr->pred_flag == PF_INTRA || left->pred_flag == PF_INTRA)
             bs = 2;
         else if (curr_cbf_luma || left_cbf_luma)
             bs = 1;
         else
-#ifdef TEST_MV_POC
-                bs = boundary_strength(s, curr, left);
-#else
-                bs = boundary_strength(s, curr, left, left_refPicList);
-#endif
+                bs = boundary_strength(s, curr, curr_refPicList, left, left_refPicList);
         if ((slice_left_boundary & 1) && (x0 % (1 << s->sps->log2_ctb_size)) == 0)
             bs = 0;
         if (s->sh.disable_deblocking_filter_flag == 1)
@@ -1234,7 +1226,6 @@ static void upsample_block_luma(HEVCContext *s, HEVCFrame *ref0, int x0, int y0)
                                                                       &s->sps->scaled_ref_layer_window[ref_layer_id], &s->up_filter_inf);
 
     }
-    s->is_upsampled[(y0 / ctb_size * s->sps->ctb_width) + (x0 / ctb_size)] = 1;
 }
 
 static void upsample_block_mc(HEVCContext *s, HEVCFrame *ref0, int x0, int y0) {
@@ -1308,63 +1299,115 @@ static void upsample_block_mc(HEVCContext *s, HEVCFrame *ref0, int x0, int y0) {
     }
 }
 
+/* The inter-layer reference lists only keep the base layer references
+ * found in the DPB, so a base layer index is mapped to the same POC. */
+static int il_ref_idx(const RefPicList *bl_list, const RefPicList *il_list, int bl_idx)
+{
+    int i;
+
+    if (bl_idx >= bl_list->nb_refs)
+        return -1;
+    for (i = 0; i < il_list->nb_refs; i++)
+        if (il_list->list[i] == bl_list->list[bl_idx])
+            return i;
+    return -1;
+}
+
 void ff_upscale_mv_block(HEVCContext *s, int ctb_x, int ctb_y) {
-    int xEL, yEL, xBL, yBL, list, Ref_pre_unit, pre_unit, pre_unit_col;
-    int pic_width_in_min_pu = s->sps->width>>s->sps->log2_min_pu_size;
-    int pic_height_in_min_pu = s->sps->height>>s->sps->log2_min_pu_size;
-    int pic_width_in_min_puBL = s->BL_frame->frame->coded_width >> s->sps->log2_min_pu_size;
-    int ctb_size = 1 << s->sps->log2_ctb_size;
-    int nb_list = s->sh.slice_type==B_SLICE ? 2:1;
+    int xEL, yEL, xBL, yBL, list;
+    int log2_min_pu = s->sps->log2_min_pu_size;
+    int pic_width_in_min_pu   = s->sps->width >> log2_min_pu;
+    int pic_width_in_min_puBL = s->BL_frame->frame->coded_width >> log2_min_pu;
+    int bl_width  = s->BL_frame->frame->coded_width;
+    int bl_height = s->BL_frame->frame->coded_height;
+    int ctb_size  = 1 << s->sps->log2_ctb_size;
+    int nb_list   = s->sh.slice_type==B_SLICE ? 2:1;
+    int scale_x   = s->sh.ScalingFactor[s->nuh_layer_id][0];
+    int scale_y   = s->sh.ScalingFactor[s->nuh_layer_id][1];
     HEVCFrame *refBL = s->BL_frame;
     HEVCFrame *refEL = s->inter_layer_ref;
+    RefPicList *bl_rpl = refBL->refPicList[s->slice_idx];
 
+    /* the collocated motion is only read on a 16x16 grid, so one unit per
+     * 16x16 block is derived */
     for(yEL=ctb_y; yEL < ctb_y+ctb_size && yEL<s->sps->height; yEL+=16) {
+        yBL = (((av_clip_c(yEL+8, 0, s->sps->height -1) - s->sps->pic_conf_win.top_offset )*s->up_filter_inf.scaleYLum + (1<<15)) >> 16) + 4;
         for(xEL=ctb_x; xEL < ctb_x+ctb_size && xEL<s->sps->width; xEL+=16) {
+            MvField *dst = &refEL->tab_mvf[(yEL >> log2_min_pu) * pic_width_in_min_pu + (xEL >> log2_min_pu)];
+            RefPicList *il_rpl;
+            MvField *src;
+
+            memset(dst, 0, sizeof(MvField));
             xBL = (((av_clip_c(xEL+8, 0, s->sps->width -1)  - s->sps->pic_conf_win.left_offset)*s->up_filter_inf.scaleXLum + (1<<15)) >> 16) + 4;
-            yBL = (((av_clip_c(yEL+8, 0, s->sps->height -1) - s->sps->pic_conf_win.top_offset )*s->up_filter_inf.scaleYLum + (1<<15)) >> 16) + 4;
-            pre_unit = ((yEL>>s->sps->log2_min_pu_size)*pic_width_in_min_pu) + (xEL>>s->sps->log2_min_pu_size);
-            if(xBL < s->BL_frame->frame->coded_width && yBL < s->BL_frame->frame->coded_height) {
-                xBL >>= 4;
-                xBL <<= 4-s->sps->log2_min_pu_size; // 4 <==> xBL & 0xFFFFFFF0
-                yBL >>= 4;
-                yBL <<= 4-s->sps->log2_min_pu_size; // 4 <==> yBL & 0xFFFFFFF0
-                Ref_pre_unit = (yBL*pic_width_in_min_puBL)+xBL;
-                if(refBL->tab_mvf[Ref_pre_unit].pred_flag) {
-                    if (s->up_filter_inf.idx == SNR) {
-                        memcpy(&refEL->tab_mvf[pre_unit], &refBL->tab_mvf[Ref_pre_unit], sizeof(MvField));
-                    } else {
+            if(xBL >= bl_width || yBL >= bl_height || !bl_rpl)
+                continue;
+            src = &refBL->tab_mvf[((yBL >> 4) << (4 - log2_min_pu)) * pic_width_in_min_puBL +
+                                  ((xBL >> 4) << (4 - log2_min_pu))];
+            il_rpl = ff_hevc_get_ref_list(s, refEL, xEL, yEL);
+            for( list=0; list < nb_list; list++) {
+                int idx = src->pred_flag & (1 << list) ?
+                          il_ref_idx(&bl_rpl[list], &il_rpl[list], src->ref_idx[list]) : -1;
+
+                if (idx < 0)
+                    continue;
+                if (s->up_filter_inf.idx == SNR) {
+                    dst->mv[list] = src->mv[list];
+                } else {
+                    dst->mv[list].x = av_clip_c((scale_x * src->mv[list].x + 127 + (scale_x * src->mv[list].x < 0)) >> 8, -32768, 32767);
+                    dst->mv[list].y = av_clip_c((scale_y * src->mv[list].y + 127 + (scale_y * src->mv[list].y < 0)) >> 8, -32768, 32767);
+                }
+                dst->ref_idx[list] = idx;
+                dst->pred_flag    |= 1 << list;
+            }
+        }
+    }
+}
 
-                        for( list=0; list < nb_list; list++) {
-                            refEL->tab_mvf[pre_unit].mv[list].x  = av_clip_c( (s->sh.ScalingFactor[s->nuh_layer_id][0] * refBL->tab_mvf[Ref_pre_unit].mv[list].x + 127 + (s->sh.ScalingFactor[s->nuh_layer_id][0] * refBL->tab_mvf[Ref_pre_unit].mv[list].x < 0)) >> 8 , -32768, 32767);
-                            refEL->tab_mvf[pre_unit].mv[list].y = av_clip_c( (s->sh.ScalingFactor[s->nuh_layer_id][1] * refBL->tab_mvf[Ref_pre_unit].mv[list].y + 127 + (s->sh.ScalingFactor[s->nuh_layer_id][1] * refBL->tab_mvf[Ref_pre_unit].mv[list].y < 0)) >> 8, -32768, 32767);
-                            refEL->tab_mvf[pre_unit].ref_idx[list] = refBL->tab_mvf[Ref_pre_unit].ref_idx[list];
-#ifdef TEST_MV_POC
-                            refEL->tab_mvf[pre_unit].poc[list] = refBL->tab_mvf[Ref_pre_unit].poc[list];
-#endif
-                            refEL->tab_mvf[pre_unit].pred_flag = refBL->tab_mvf[Ref_pre_unit].pred_flag;
-                        }
-                    }
-                } else
-                    memset(&refEL->tab_mvf[pre_unit], 0, sizeof(MvField));
+/**
+ * Derive the upscaled motion field of the inter-layer reference CTB
+ * containing (x0, y0), on its first use.
+ */
+void ff_upsample_mv_block(HEVCContext *s, int x0, int y0)
+{
+    int log2_ctb = s->sps->log2_ctb_size;
+    int ctb_x    = av_clip(x0, 0, s->sps->width  - 1) >> log2_ctb;
+    int ctb_y    = av_clip(y0, 0, s->sps->height - 1) >> log2_ctb;
+    int ctb_addr = ctb_y * s->sps->ctb_width + ctb_x;
+
+    if (s->is_mv_upsampled[ctb_addr])
+        return;
+    ff_upscale_mv_block(s, ctb_x << log2_ctb, ctb_y << log2_ctb);
+    s->is_mv_upsampled[ctb_addr] = 1;
+}
+
+/**
+ * Wait for the base layer rows which are upsampled into the enhancement
+ * layer rows above el_y, the base layer reports its progress per CTB row.
+ */
+void ff_hevc_await_bl_row(HEVCContext *s, int el_y)
+{
+    int bl_y;
 
+    if (!(s->threads_type & FF_THREAD_FRAME))
+        return;
+    bl_y = (((el_y - s->sps->pic_conf_win.top_offset) * s->up_filter_inf.scaleYLum +
+             s->up_filter_inf.addYLum) >> 12) >> 4;
+    ff_thread_await_progress(&s->BL_frame->tf, bl_y, 0);
+}
 
-            } else
-                memset(&refEL->tab_mvf[pre_unit], 0, sizeof(MvField));
+/* The samples of an aliased base layer picture are already there, only
+ * the motion field is derived. */
+static void upsample_ctb(HEVCContext *s, HEVCFrame *ref0, int x0, int y0)
+{
+    int ctb_addr = (y0 >> s->sps->log2_ctb_size) * s->sps->ctb_width +
+                   (x0 >> s->sps->log2_ctb_size);
 
-            if( ((xEL+1)>>s->sps->log2_min_pu_size) < pic_width_in_min_pu && ((yEL+1)>>s->sps->log2_min_pu_size) < pic_height_in_min_pu) {
-                pre_unit_col = (((yEL+1)>>s->sps->log2_min_pu_size)*pic_width_in_min_pu) + ((xEL+1)>>s->sps->log2_min_pu_size);
-                memcpy(&refEL->tab_mvf[pre_unit_col], &refEL->tab_mvf[pre_unit], sizeof(MvField));
-            }
-            if( ((xEL+1)>>s->sps->log2_min_pu_size) < pic_width_in_min_pu) {
-                pre_unit_col = ((yEL>>s->sps->log2_min_pu_size)*pic_width_in_min_pu) + ((xEL+1)>>s->sps->log2_min_pu_size);
-                memcpy(&refEL->tab_mvf[pre_unit_col], &refEL->tab_mvf[pre_unit], sizeof(MvField));
-            }
-            if( ((yEL+1)>>s->sps->log2_min_pu_size) < pic_height_in_min_pu) {
-                pre_unit_col = (((yEL+1)>>s->sps->log2_min_pu_size)*pic_width_in_min_pu) + ((xEL)>>s->sps->log2_min_pu_size);
-                memcpy(&refEL->tab_mvf[pre_unit_col], &refEL->tab_mvf[pre_unit], sizeof(MvField));
-            }
-        }
+    ff_upsample_mv_block(s, x0, y0);
+    if (!s->bl_aliased) {
+        upsample_block_mc  (s, ref0, x0 >> 1, y0 >> 1);
+        upsample_block_luma(s, ref0, x0     , y0);
     }
+    s->is_upsampled[ctb_addr] = 1;
 }
 
 void ff_upsample_block(HEVCContext *s, HEVCFrame *ref0, int x0, int y0, int nPbW, int nPbH) {
@@ -1377,50 +1420,33 @@ void ff_upsample_block(HEVCContext *s, HEVCFrame *ref0, int x0, int y0, int nPbW
     if ((x0 - ctb_x0) < MAX_EDGE &&
         ctb_x0 > ctb_size        &&
         !s->is_upsampled[(ctb_y0 / ctb_size * s->sps->ctb_width)+((ctb_x0 - ctb_size) / ctb_size)]){
-        ff_upscale_mv_block(s, ctb_x0 - ctb_size            , ctb_y0);
-        upsample_block_mc  (s, ref0, (ctb_x0-ctb_size) >> 1 , ctb_y0 >> 1);
-        upsample_block_luma(s, ref0, ctb_x0-ctb_size        , ctb_y0);
+        upsample_ctb(s, ref0, ctb_x0 - ctb_size, ctb_y0);
     }
 
     if ((y0 - ctb_y0) < MAX_EDGE &&
         ctb_y0 > ctb_size &&
         !s->is_upsampled[((ctb_y0 - ctb_size) / ctb_size * s->sps->ctb_width) + (ctb_x0 / ctb_size)]){
-        ff_upscale_mv_block(s, ctb_x0            , ctb_y0 - ctb_size);
-        upsample_block_mc  (s, ref0, ctb_x0 >> 1 , (ctb_y0 - ctb_size) >> 1);
-        upsample_block_luma(s, ref0, ctb_x0      , ctb_y0 - ctb_size);
+        upsample_ctb(s, ref0, ctb_x0, ctb_y0 - ctb_size);
     }
 
     if(!s->is_upsampled[(ctb_y0 / ctb_size * s->sps->ctb_width) + (ctb_x0 / ctb_size)]){
-        ff_upscale_mv_block(s, ctb_x0           , ctb_y0);
-        upsample_block_mc  (s, ref0, ctb_x0 >> 1, ctb_y0 >> 1);
-        upsample_block_luma(s, ref0, ctb_x0     , ctb_y0);
-
+        upsample_ctb(s, ref0, ctb_x0, ctb_y0);
     }
 
     if((((x0 + nPbW + MAX_EDGE) >> log2_ctb) << log2_ctb) > ctb_x0 && ((ctb_x0 + ctb_size) < s->sps->width) &&
        !s->is_upsampled[(ctb_y0 / ctb_size * s->sps->ctb_width) + ((ctb_x0 + ctb_size) / ctb_size)]){
-        ff_upscale_mv_block(s, ctb_x0 + ctb_size, ctb_y0);
-        upsample_block_mc  (s, ref0, (ctb_x0 + ctb_size) >> 1, ctb_y0 >> 1);
-        upsample_block_luma(s, ref0, ctb_x0 + ctb_size       , ctb_y0);
+        upsample_ctb(s, ref0, ctb_x0 + ctb_size, ctb_y0);
     }
 
     if((((y0 + nPbH + MAX_EDGE) >> log2_ctb) << log2_ctb) > ctb_y0 &&
        ((ctb_y0 + ctb_size) < s->sps->height)) {
         if (!s->is_upsampled[((ctb_y0 + ctb_size) / ctb_size * s->sps->ctb_width) + (ctb_x0 / ctb_size)]){
-            if (s->threads_type & FF_THREAD_FRAME ) {
-                int bl_y = ctb_y0 + ctb_size + ctb_size * 2 + 9;
-                bl_y = (( (bl_y  - s->sps->pic_conf_win.top_offset) * s->up_filter_inf.scaleYLum + s->up_filter_inf.addYLum) >> 12) >> 4;
-                ff_thread_await_progress(&s->BL_frame->tf, bl_y, 0);
-            }
-            ff_upscale_mv_block(s, ctb_x0, ctb_y0 + ctb_size);
-            upsample_block_mc  (s, ref0, ctb_x0 >> 1, (ctb_y0 + ctb_size) >> 1);
-            upsample_block_luma(s, ref0, ctb_x0     , ctb_y0 + ctb_size);
+            ff_hevc_await_bl_row(s, ctb_y0 + ctb_size + ctb_size * 2 + 9);
+            upsample_ctb(s, ref0, ctb_x0, ctb_y0 + ctb_size);
         }
         if((((x0 + nPbW + MAX_EDGE) >> log2_ctb) << log2_ctb) > ctb_x0 && ((ctb_x0 + ctb_size) < s->sps->width) &&
            !s->is_upsampled[((ctb_y0 + ctb_size) / ctb_size * s->sps->ctb_width) + ((ctb_x0 + ctb_size) / ctb_size)]){
-            ff_upscale_mv_block(s, ctb_x0 + ctb_size, ctb_y0 + ctb_size);
-            upsample_block_mc  (s, ref0, (ctb_x0 + ctb_size) >> 1, (ctb_y0 + ctb_size) >> 1);
-            upsample_block_luma(s, ref0, (ctb_x0 + ctb_size)    , ctb_y0 + ctb_size);
+            upsample_ctb(s, ref0, ctb_x0 + ctb_size, ctb_y0 + ctb_size);
         }
     }
 }
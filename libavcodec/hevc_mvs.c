@@ -98,16 +98,6 @@ static av_always_inline int compare_mv_ref_idx(struct MvField A, struct MvField
     int a_pf = A.pred_flag;
     int b_pf = B.pred_flag;
     if (a_pf == b_pf) {
-#ifdef TEST_MV_POC
-        if (a_pf == PF_BI) {
-            return MATCH(poc[0]) && MATCH(mv[0].x) && MATCH(mv[0].y) &&
-                   MATCH(poc[1]) && MATCH(mv[1].x) && MATCH(mv[1].y);
-        } else if (a_pf == PF_L0) {
-            return MATCH(poc[0]) && MATCH(mv[0].x) && MATCH(mv[0].y);
-        } else if (a_pf == PF_L1) {
-            return MATCH(poc[1]) && MATCH(mv[1].x) && MATCH(mv[1].y);
-        }
-#else
         if (a_pf == PF_BI) {
             return MATCH(ref_idx[0]) && MATCH(mv[0].x) && MATCH(mv[0].y) &&
                    MATCH(ref_idx[1]) && MATCH(mv[1].x) && MATCH(mv[1].y);
@@ -116,7 +106,6 @@ static av_always_inline int compare_mv_ref_idx(struct MvField A, struct MvField
         } else if (a_pf == PF_L1) {
             return MATCH(ref_idx[1]) && MATCH(mv[1].x) && MATCH(mv[1].y);
         }
-#endif
     }
     return 0;
 }
@@ -248,12 +237,11 @@ static int temporal_luma_motion_vector(HEVCContext *s, int x0, int y0,
     y = y0 + nPbH;
 #if ACTIVE_PU_UPSAMPLING
     if(ref == s->inter_layer_ref ) {
-        if (s->threads_type & FF_THREAD_FRAME ){
-            int bl_y = y0 + (1<<s->sps->log2_ctb_size)*2 + 9;
-            bl_y = (( (bl_y  - s->sps->pic_conf_win.top_offset) * s->up_filter_inf.scaleYLum + s->up_filter_inf.addYLum) >> 12) >> 4;
-            ff_thread_await_progress(&s->BL_frame->tf, bl_y, 0);
-        }
-        ff_upsample_block(s, ref, x0 , y0, nPbW, nPbH);
+        /* only the motion of the bottom right and center candidates is needed */
+        ff_hevc_await_bl_row(s, y0 + (1<<s->sps->log2_ctb_size)*2 + 9);
+        if (y < s->sps->height && x < s->sps->width)
+            ff_upsample_mv_block(s, x, y);
+        ff_upsample_mv_block(s, x0 + (nPbW >> 1), y0 + (nPbH >> 1));
     }
 #endif
     if (s->threads_type & FF_THREAD_FRAME )
@@ -430,16 +418,10 @@ static void derive_spatial_merge_candidates(HEVCContext *s, int x0, int y0,
             if (available_l0) {
                 mergecandlist[nb_merge_cand].mv[0]      = mv_l0_col;
                 mergecandlist[nb_merge_cand].ref_idx[0] = 0;
-#ifdef TEST_MV_POC
-                mergecandlist[nb_merge_cand].poc[0]     = refPicList[0].list[0];
-#endif
             }
             if (available_l1) {
                 mergecandlist[nb_merge_cand].mv[1]      = mv_l1_col;
                 mergecandlist[nb_merge_cand].ref_idx[1] = 0;
-#ifdef TEST_MV_POC
-                mergecandlist[nb_merge_cand].poc[1]     = refPicList[1].list[0];
-#endif
             }
             if (merge_idx == nb_merge_cand) return;
             nb_merge_cand++;
@@ -463,12 +445,8 @@ static void derive_spatial_merge_candidates(HEVCContext *s, int x0, int y0,
             if ((l0_cand.pred_flag & PF_L0) &&
                 (l1_cand.pred_flag & PF_L1) &&
                 (
-#ifdef TEST_MV_POC
-                 l0_cand.poc[0] != l1_cand.poc[1] ||
-#else
                  refPicList[0].list[l0_cand.ref_idx[0]] !=
                  refPicList[1].list[l1_cand.ref_idx[1]] ||
-#endif
                  l0_cand.mv[0].x != l1_cand.mv[1].x ||
                  l0_cand.mv[0].y != l1_cand.mv[1].y)) {
                 mergecandlist[nb_merge_cand].ref_idx[0]   = l0_cand.ref_idx[0];
@@ -476,10 +454,6 @@ static void derive_spatial_merge_candidates(HEVCContext *s, int x0, int y0,
                 mergecandlist[nb_merge_cand].pred_flag    = PF_BI;
                 mergecandlist[nb_merge_cand].mv[0]        = l0_cand.mv[0];
                 mergecandlist[nb_merge_cand].mv[1]        = l1_cand.mv[1];
-#ifdef TEST_MV_POC
-                mergecandlist[nb_merge_cand].poc[0]       = l0_cand.poc[0];
-                mergecandlist[nb_merge_cand].poc[1]       = l1_cand.poc[1];
-#endif
                 if (merge_idx == nb_merge_cand) return;
                 nb_merge_cand++;
             }
@@ -495,10 +469,6 @@ static void derive_spatial_merge_candidates(HEVCContext *s, int x0, int y0,
         mergecandlist[nb_merge_cand].mv[1].y      = 0;
         mergecandlist[nb_merge_cand].ref_idx[0]   = zero_idx < nb_refs ? zero_idx : 0;
         mergecandlist[nb_merge_cand].ref_idx[1]   = zero_idx < nb_refs ? zero_idx : 0;
-#ifdef TEST_MV_POC
-        mergecandlist[nb_merge_cand].poc[0]       = refPicList[0].list[zero_idx < nb_refs ? zero_idx : 0];
-        mergecandlist[nb_merge_cand].poc[1]       = refPicList[1].list[zero_idx < nb_refs ? zero_idx : 0];
-#endif
         if (merge_idx == nb_merge_cand) return;
         nb_merge_cand++;
         zero_idx++;
@@ -547,11 +517,7 @@ static av_always_inline void dist_scale(HEVCContext *s, Mv *mv,
 {
     RefPicList *refPicList = s->ref->refPicList[s->slice_idx];
     MvField *tab_mvf       = s->ref->tab_mvf;
-#ifdef TEST_MV_POC
-    int ref_pic_elist      = TAB_MVF(x, y).poc[elist];
-#else
     int ref_pic_elist      = refPicList[elist].list[TAB_MVF(x, y).ref_idx[elist]];
-#endif
     int ref_pic_curr       = refPicList[ref_idx_curr].list[ref_idx];
 
     if (ref_pic_elist != ref_pic_curr) {
@@ -571,11 +537,7 @@ static int mv_mp_mode_mx(HEVCContext *s, int x, int y, int pred_flag_index,
     RefPicList *refPicList = s->ref->refPicList[s->slice_idx];
 
     if (((TAB_MVF(x, y).pred_flag) & (1 << pred_flag_index)) &&
-#ifdef TEST_MV_POC
-        TAB_MVF(x, y).poc[pred_flag_index] == refPicList[ref_idx_curr].list[ref_idx]
-#else
         refPicList[pred_flag_index].list[TAB_MVF(x, y).ref_idx[pred_flag_index]] == refPicList[ref_idx_curr].list[ref_idx]
-#endif
     ) {
         *mv = TAB_MVF(x, y).mv[pred_flag_index];
         return 1;
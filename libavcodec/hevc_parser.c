@@ -21,6 +21,7 @@
  */
 
 #include "libavutil/common.h"
+#include "libavutil/intreadwrite.h"
 
 #include "parser.h"
 #include "hevc.h"
@@ -33,6 +34,38 @@ typedef struct HEVCParseContext {
     ParseContext pc;
 } HEVCParseContext;
 
+/**
+ * Skip to the next start code prefix in buf, starting with the one that
+ * would be completed at byte i.
+ * @return the index of the byte following the 2-byte NAL unit header of the
+ *         start code found, or buf_size if there is none
+ */
+static av_always_inline int find_next_nal_header(const uint8_t *buf, int i,
+                                                 int buf_size)
+{
+    int q = i - 5;
+
+    while (q + 5 < buf_size) {
+#if HAVE_FAST_UNALIGNED && HAVE_FAST_64BIT
+        if (q + 8 <= buf_size) {
+            uint64_t x = AV_RN64(buf + q);
+            // no zero byte in the next 8 bytes, no start code can begin there
+            if (!((x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL)) {
+                q += 8;
+                continue;
+            }
+        }
+#endif
+        if (buf[q + 2] > 1)
+            q += 3;
+        else if (!buf[q] && !buf[q + 1] && buf[q + 2] == 1)
+            return q + 5;
+        else
+            q++;
+    }
+    return buf_size;
+}
+
 /**
  * Find the end of the current frame in the bitstream.
  * @return the position of the first byte of the next frame, or END_NOT_FOUND
@@ -46,7 +79,17 @@ static int hevc_find_frame_end(AVCodecParserContext *s, const uint8_t *buf,
     for (i = 0; i < buf_size; i++) {
         int nut, layer_id;
 
-        pc->state64 = (pc->state64 << 8) | buf[i];
+        /* Once the state can be rebuilt from the buffer alone, jump over
+         * the bytes that cannot complete a start code. */
+        if (i >= 8) {
+            i = find_next_nal_header(buf, i, buf_size);
+            if (i >= buf_size) {
+                pc->state64 = AV_RB64(buf + buf_size - 8);
+                break;
+            }
+            pc->state64 = AV_RB64(buf + i - 7);
+        } else
+            pc->state64 = (pc->state64 << 8) | buf[i];
 
         if (((pc->state64 >> 3 * 8) & 0xFFFFFF) != START_CODE)
             continue;
@@ -328,12 +371,21 @@ static void hevc_close(AVCodecParserContext *s)
     av_freep(&h->HEVClc);
     av_freep(&pc->buffer);
 
-    for (i = 0; i < FF_ARRAY_ELEMS(h->vps_list); i++)
+    for (i = 0; i < FF_ARRAY_ELEMS(h->vps_list); i++) {
         av_buffer_unref(&h->vps_list[i]);
-    for (i = 0; i < FF_ARRAY_ELEMS(h->sps_list); i++)
+        av_buffer_unref(&h->vps_rbsp[i]);
+    }
+    for (i = 0; i < FF_ARRAY_ELEMS(h->sps_list); i++) {
         av_buffer_unref(&h->sps_list[i]);
-    for (i = 0; i < FF_ARRAY_ELEMS(h->pps_list); i++)
+        av_buffer_unref(&h->sps_rbsp[i]);
+    }
+    for (i = 0; i < FF_ARRAY_ELEMS(h->pps_list); i++) {
         av_buffer_unref(&h->pps_list[i]);
+        av_buffer_unref(&h->pps_rbsp[i]);
+    }
+    av_buffer_pool_uninit(&h->vps_pool);
+    av_buffer_pool_uninit(&h->vps_base_pool);
+    av_buffer_pool_uninit(&h->sps_pool);
 
     for (i = 0; i < h->nals_allocated; i++)
         av_freep(&h->nals[i].rbsp_buffer);
@@ -476,7 +476,7 @@ static void deriveLayerIdListVariables(HEVCVPS *vps)
     for( i = 1; i <= vps->vps_num_layer_sets - 1; i++ )
     {
         n = 0;
-        for( m = 0; m <= vps->vps_max_layer_id; m++)
+        for( m = 0; m <= FFMIN(vps->vps_max_layer_id, MAX_VPS_LAYER_ID_PLUS1 - 1); m++)
         {
             if(vps->m_layerIdIncludedFlag[i][ m])
             {
@@ -711,7 +711,7 @@ static void parseVPSVUI(GetBitContext *gb, HEVCVPS *vps)
 }
 #endif
 
-static void parse_vps_extension (HEVCContext *s, HEVCVPS *vps)  {
+static int parse_vps_extension (HEVCContext *s, HEVCVPS *vps)  {
     int i, j, k;
     GetBitContext *gb = &s->HEVClc->gb;
     print_cabac(" \n --- parse vps extention  --- \n ", s->nuh_layer_id);
@@ -756,6 +756,11 @@ static void parse_vps_extension (HEVCContext *s, HEVCVPS *vps)  {
             print_cabac("layer_id_in_nuh", vps->layer_id_in_nuh[i]); 
         } else
             vps->layer_id_in_nuh[i] = i;
+        if (vps->layer_id_in_nuh[i] >= MAX_VPS_LAYER_ID_PLUS1) {
+            av_log(s->avctx, AV_LOG_ERROR, "layer_id_in_nuh %d not supported\n",
+                   vps->layer_id_in_nuh[i]);
+            return AVERROR_PATCHWELCOME;
+        }
         vps->m_layerIdInVps[vps->layer_id_in_nuh[i]] = i;
         for(j = 0; j < numScalabilityTypes; j++)    {
             vps->dimension_id[i][j]= get_bits(gb, vps->dimension_id_len[j]);
@@ -1092,6 +1097,27 @@ static void parse_vps_extension (HEVCContext *s, HEVCVPS *vps)  {
     }
 #endif
 #endif
+    return 0;
+}
+
+/* Parameter sets are commonly repeated before every IRAP picture. The RBSP
+ * each stored one was parsed from is kept next to it in the context, so that
+ * a repeat can be recognized before parsing and the derived tables are kept
+ * as they are. */
+static int ps_rbsp_equal(const AVBufferRef *rbsp, const uint8_t *buf, int size)
+{
+    return rbsp && rbsp->size == size && !memcmp(rbsp->data, buf, size);
+}
+
+/* a failed copy only costs parsing the next repeat */
+static void ps_rbsp_store(AVBufferRef **rbsp, const uint8_t *buf, int size)
+{
+    if (ps_rbsp_equal(*rbsp, buf, size))
+        return;
+    av_buffer_unref(rbsp);
+    *rbsp = av_buffer_alloc(size);
+    if (*rbsp)
+        memcpy((*rbsp)->data, buf, size);
 }
 
 int ff_hevc_decode_nal_vps(HEVCContext *s)
@@ -1100,11 +1126,34 @@ int ff_hevc_decode_nal_vps(HEVCContext *s)
     GetBitContext *gb = &s->HEVClc->gb;
     int vps_id = 0;
     HEVCVPS *vps;
-    AVBufferRef *vps_buf = av_buffer_allocz(sizeof(*vps));
+    AVBufferRef *vps_buf, *base_buf;
+    const uint8_t *rbsp = gb->buffer;
+    int rbsp_size       = gb->buffer_end - gb->buffer;
+
+    for (i = 0; i < MAX_VPS_COUNT; i++) {
+        if (s->vps_list[i] && ps_rbsp_equal(s->vps_rbsp[i], rbsp, rbsp_size)) {
+            av_log(s->avctx, AV_LOG_DEBUG, "ignore VPS duplicated\n");
+            return 0;
+        }
+    }
+
+    /* parse into a recycled full size buffer, only the base part is cleared
+     * here, the extension part once vps_extension_flag is known */
+    if (!s->vps_pool) {
+        s->vps_pool      = av_buffer_pool_init(sizeof(*vps), NULL);
+        s->vps_base_pool = av_buffer_pool_init(HEVC_VPS_BASE_SIZE, NULL);
+        if (!s->vps_pool || !s->vps_base_pool) {
+            av_buffer_pool_uninit(&s->vps_pool);
+            av_buffer_pool_uninit(&s->vps_base_pool);
+            return AVERROR(ENOMEM);
+        }
+    }
+    vps_buf = av_buffer_pool_get(s->vps_pool);
     print_cabac(" \n --- parse vps --- \n ", s->nuh_layer_id);
     if (!vps_buf)
         return AVERROR(ENOMEM);
     vps = (HEVCVPS*)vps_buf->data;
+    memset(vps, 0, HEVC_VPS_BASE_SIZE);
 
     av_log(s->avctx, AV_LOG_DEBUG, "Decoding VPS\n");
 
@@ -1172,11 +1221,18 @@ int ff_hevc_decode_nal_vps(HEVCContext *s)
     vps->vps_num_layer_sets = get_ue_golomb_long(gb) + 1;
     print_cabac("vps_max_layer_id", vps->vps_max_layer_id);
     print_cabac("vps_num_layer_sets_minus1", vps->vps_num_layer_sets - 1);
+    if (vps->vps_num_layer_sets > MAX_VPS_LAYER_SETS_PLUS1) {
+        av_log(s->avctx, AV_LOG_ERROR, "vps_num_layer_sets_minus1 out of range: %d\n",
+               vps->vps_num_layer_sets - 1);
+        goto err;
+    }
 
     for (i = 1; i < vps->vps_num_layer_sets; i++)
         for (j = 0; j <= vps->vps_max_layer_id; j++) {
-            vps->m_layerIdIncludedFlag[i][j] = (get_bits1(gb) == 1);
-            print_cabac("layer_id_included_flag", vps->m_layerIdIncludedFlag[i][j]);
+            int flag = get_bits1(gb);
+            print_cabac("layer_id_included_flag", flag);
+            if (j < MAX_VPS_LAYER_ID_PLUS1)
+                vps->m_layerIdIncludedFlag[i][j] = flag;
         }
 #if DERIVE_LAYER_ID_LIST_VARIABLES
     deriveLayerIdListVariables(vps);
@@ -1196,6 +1252,11 @@ int ff_hevc_decode_nal_vps(HEVCContext *s)
         }
         vps->vps_num_hrd_parameters = get_ue_golomb_long(gb);
         print_cabac("vps_num_hrd_parameters", vps->vps_num_hrd_parameters);
+        if (vps->vps_num_hrd_parameters > FF_ARRAY_ELEMS(vps->m_hrdOpSetIdx)) {
+            av_log(s->avctx, AV_LOG_ERROR, "vps_num_hrd_parameters out of range: %d\n",
+                   vps->vps_num_hrd_parameters);
+            goto err;
+        }
         for (i = 0; i < vps->vps_num_hrd_parameters; i++) {
             int common_inf_present = 1;
             vps->m_hrdOpSetIdx[i] = get_ue_golomb_long(gb);// hrd_layer_set_idx
@@ -1212,12 +1273,31 @@ int ff_hevc_decode_nal_vps(HEVCContext *s)
 #if VPS_EXTENSION
 
     if(vps->vps_extension_flag){ // vps_extension_flag
+        memset((uint8_t *)vps + HEVC_VPS_BASE_SIZE, 0, sizeof(*vps) - HEVC_VPS_BASE_SIZE);
+        if (vps->vps_max_layers > MAX_LAYERS) {
+            av_log(s->avctx, AV_LOG_ERROR, "vps_max_layers %d not supported, at most %d layers\n",
+                   vps->vps_max_layers, MAX_LAYERS);
+            goto err;
+        }
         align_get_bits(gb);
-        parse_vps_extension(s, vps);
+        if (parse_vps_extension(s, vps) < 0)
+            goto err;
     }
 #endif
 
-    if (s->vps_list[vps_id] &&
+    /* without the extension only the base part is kept around */
+    if (!vps->vps_extension_flag && HEVC_VPS_BASE_SIZE < sizeof(*vps)) {
+        base_buf = av_buffer_pool_get(s->vps_base_pool);
+        if (!base_buf) {
+            av_buffer_unref(&vps_buf);
+            return AVERROR(ENOMEM);
+        }
+        memcpy(base_buf->data, vps, HEVC_VPS_BASE_SIZE);
+        av_buffer_unref(&vps_buf);
+        vps_buf = base_buf;
+    }
+
+    if (s->vps_list[vps_id] && s->vps_list[vps_id]->size == vps_buf->size &&
         !memcmp(s->vps_list[vps_id]->data, vps_buf->data, vps_buf->size)) {
         av_buffer_unref(&vps_buf);
         av_log(s->avctx, AV_LOG_DEBUG, "ignore VPS duplicated\n");
@@ -1225,6 +1305,7 @@ int ff_hevc_decode_nal_vps(HEVCContext *s)
         av_buffer_unref(&s->vps_list[vps_id]);
         s->vps_list[vps_id] = vps_buf;
     }
+    ps_rbsp_store(&s->vps_rbsp[vps_id], rbsp, rbsp_size);
     return 0;
 
 err:
@@ -1529,11 +1610,28 @@ int ff_hevc_decode_nal_sps(HEVCContext *s)
     print_cabac(" \n --- parse sps --- \n ", s->nuh_layer_id);
     HEVCSPS *sps;
     HEVCVPS *vps;
-    AVBufferRef *sps_buf = av_buffer_allocz(sizeof(*sps));
+    AVBufferRef *sps_buf;
+    const uint8_t *rbsp = gb->buffer;
+    int rbsp_size       = gb->buffer_end - gb->buffer;
+
+    /* an enhancement layer SPS inherits fields from the VPS, so only base
+     * layer repeats can be recognized from the RBSP alone */
+    if (!s->nuh_layer_id) {
+        for (i = 0; i < MAX_SPS_COUNT; i++)
+            if (s->sps_list[i] && ps_rbsp_equal(s->sps_rbsp[i], rbsp, rbsp_size))
+                return 0;
+    }
 
+    if (!s->sps_pool) {
+        s->sps_pool = av_buffer_pool_init(sizeof(*sps), NULL);
+        if (!s->sps_pool)
+            return AVERROR(ENOMEM);
+    }
+    sps_buf = av_buffer_pool_get(s->sps_pool);
     if ( !sps_buf )
         return AVERROR(ENOMEM);
     sps = (HEVCSPS*)sps_buf->data;
+    memset(sps, 0, sizeof(*sps));
     sps->chroma_array_type = sps->chroma_format_idc = 1; //FIXME shouldn't it be passing from BL
     av_log(s->avctx, AV_LOG_DEBUG, "Decoding SPS\n");
 
@@ -1553,6 +1651,12 @@ int ff_hevc_decode_nal_sps(HEVCContext *s)
         goto err;
     }
     vps = ((HEVCVPS*)s->vps_list[sps->vps_id]->data);
+    if (s->nuh_layer_id && !vps->vps_extension_flag) {
+        av_log(s->avctx, AV_LOG_ERROR, "VPS %d has no extension for layer %d\n",
+               sps->vps_id, s->nuh_layer_id);
+        ret = AVERROR_INVALIDDATA;
+        goto err;
+    }
     if (s->nuh_layer_id ==0) {
         sps->max_sub_layers = get_bits(gb, 3) + 1;
         print_cabac("sps_max_sub_layers_minus1", sps->max_sub_layers-1);
@@ -2058,6 +2162,7 @@ int ff_hevc_decode_nal_sps(HEVCContext *s)
         av_buffer_unref(&s->sps_list[sps_id]);
         s->sps_list[sps_id] = sps_buf;
     }
+    ps_rbsp_store(&s->sps_rbsp[sps_id], rbsp, rbsp_size);
     return 0;
 
 err:
@@ -2079,6 +2184,7 @@ static void hevc_pps_free(void *opaque, uint8_t *data)
     av_freep(&pps->tile_id);
     av_freep(&pps->tile_width);
     av_freep(&pps->min_tb_addr_zs_tab);
+    av_buffer_unref(&pps->sps_buf);
 
     av_freep(&pps);
 }
@@ -2161,7 +2267,23 @@ int ff_hevc_decode_nal_pps(HEVCContext *s)
     int pps_id = 0;
 
     AVBufferRef *pps_buf;
-    HEVCPPS *pps = av_mallocz(sizeof(*pps));
+    HEVCPPS *pps;
+    GetBitContext gb_id = *gb;
+    const uint8_t *rbsp = gb->buffer;
+    int rbsp_size       = gb->buffer_end - gb->buffer;
+
+    /* a repeated PPS keeps its tables as long as they were derived from the
+     * SPS currently stored under its sps_id */
+    pps_id = get_ue_golomb_long(&gb_id);
+    if (pps_id < MAX_PPS_COUNT && s->pps_list[pps_id]) {
+        pps = (HEVCPPS*)s->pps_list[pps_id]->data;
+        if (ps_rbsp_equal(s->pps_rbsp[pps_id], rbsp, rbsp_size) &&
+            s->sps_list[pps->sps_id] &&
+            s->sps_list[pps->sps_id]->data == pps->sps_buf->data)
+            return 0;
+    }
+
+    pps = av_mallocz(sizeof(*pps));
     print_cabac(" --- parse pps --- ", s->nuh_layer_id);
     if (!pps)
         return AVERROR(ENOMEM);
@@ -2206,6 +2328,11 @@ int ff_hevc_decode_nal_pps(HEVCContext *s)
         goto err;
     }
     sps = (HEVCSPS *)s->sps_list[pps->sps_id]->data;
+    pps->sps_buf = av_buffer_ref(s->sps_list[pps->sps_id]);
+    if (!pps->sps_buf) {
+        ret = AVERROR(ENOMEM);
+        goto err;
+    }
 
     pps->dependent_slice_segments_enabled_flag = get_bits1(gb);
     pps->output_flag_present_flag              = get_bits1(gb);
@@ -2572,6 +2699,7 @@ int ff_hevc_decode_nal_pps(HEVCContext *s)
     av_freep(&row_bd);
     av_buffer_unref(&s->pps_list[pps_id]);
     s->pps_list[pps_id] = pps_buf;
+    ps_rbsp_store(&s->pps_rbsp[pps_id], rbsp, rbsp_size);
 
     return 0;
 
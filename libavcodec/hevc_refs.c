@@ -34,15 +34,13 @@ void ff_hevc_unref_frame(HEVCContext *s, HEVCFrame *frame, int flags) {
     frame->flags &= ~flags;
     if (!frame->flags) {
         ff_thread_release_buffer(s->avctx, &frame->tf);
-        av_buffer_unref(&frame->tab_mvf_buf);
-        frame->tab_mvf = NULL;
-        av_buffer_unref(&frame->rpl_buf);
-        av_buffer_unref(&frame->rpl_tab_buf);
-        frame->rpl_tab    = NULL;
+        av_buffer_unref(&frame->meta_buf);
+        frame->tab_mvf       = NULL;
+        frame->rpl           = NULL;
+        frame->rpl_slice_idx = NULL;
         for(i=0; i < MAX_SLICES_IN_FRAME; i++) 
             frame->refPicList[i] = NULL;
         frame->collocated_ref = NULL;
-        
     }
 }
 
@@ -52,7 +50,7 @@ RefPicList *ff_hevc_get_ref_list(HEVCContext *s, HEVCFrame *ref, int x0, int y0)
     int y_cb         = y0 >> s->sps->log2_ctb_size;
     int pic_width_cb = s->sps->ctb_width;
     int ctb_addr_ts  = s->pps->ctb_addr_rs_to_ts[y_cb * pic_width_cb + x_cb];
-    return (RefPicList *)ref->rpl_tab[ctb_addr_ts];
+    return ref->rpl[ref->rpl_slice_idx[ctb_addr_ts]].refPicList;
 }
 
 void ff_hevc_clear_refs(HEVCContext *s)
@@ -72,35 +70,90 @@ void ff_hevc_flush_dpb(HEVCContext *s)
         ff_hevc_unref_frame(s, &s->DPB[i], ~0);
 }
 
-static HEVCFrame *alloc_frame(HEVCContext *s)
+/* every frame thread has its own tables, local contexts and picture in flight */
+static int nb_frame_contexts(HEVCContext *s)
 {
-    int i, j, ret;
+    return (s->threads_type & FF_THREAD_FRAME) ? s->avctx->thread_count_frame : 1;
+}
+
+static int nb_allocated_frames(HEVCContext *s)
+{
+    int i, nb_frames = 0;
+    for (i = 0; i < FF_ARRAY_ELEMS(s->DPB); i++)
+        if (s->DPB[i].frame->buf[0])
+            nb_frames++;
+    return nb_frames;
+}
+
+int64_t ff_hevc_mem_estimate(HEVCContext *s, int nb_frames)
+{
+    int64_t fixed = s->mem_tables + FFMAX(s->mem_scratch, s->mem_scratch_max) +
+                    s->mem_upsampling;
+    return nb_frame_contexts(s) * fixed +
+           nb_frames * (s->mem_picture + s->mem_frame_meta);
+}
+
+void ff_hevc_update_mem_usage(HEVCContext *s)
+{
+    AVHEVCMemoryUsage *mem = s->avctx->hevc_mem_usage;
+    int nb_contexts = nb_frame_contexts(s);
+    int nb_frames;
+
+    if (!mem)
+        return;
+
+    nb_frames = nb_allocated_frames(s) + nb_contexts - 1;
+
+    mem->tables     = nb_contexts * s->mem_tables;
+    mem->scratch    = nb_contexts * s->mem_scratch;
+    mem->upsampling = nb_contexts * s->mem_upsampling;
+    mem->frames     = nb_frames * s->mem_picture;
+    mem->frame_meta = nb_frames * s->mem_frame_meta;
+    mem->total      = mem->tables + mem->scratch + mem->upsampling +
+                      mem->frames + mem->frame_meta;
+    mem->peak       = FFMAX(mem->peak, mem->total);
+}
+
+/* a src frame is referenced instead of getting a new buffer */
+static HEVCFrame *alloc_frame(HEVCContext *s, AVFrame *src)
+{
+    int i, ret;
     for (i = 0; i < FF_ARRAY_ELEMS(s->DPB); i++) {
         HEVCFrame *frame = &s->DPB[i];
         if (frame->frame->buf[0])
             continue;
 
-        ret = ff_thread_get_buffer(s->avctx, &frame->tf,
-                                   AV_GET_BUFFER_FLAG_REF);
+        if (s->mem_budget) {
+            int nb_frames = nb_allocated_frames(s) + nb_frame_contexts(s);
+            if (ff_hevc_mem_estimate(s, nb_frames) > s->mem_budget) {
+                av_log(s->avctx, AV_LOG_ERROR,
+                       "Allocating picture %d would exceed the memory budget, decoder_%d.\n",
+                       nb_frames, s->decoder_id);
+                return NULL;
+            }
+        }
+
+        if (src) {
+            ret = av_frame_ref(frame->frame, src);
+            frame->tf.owner = s->avctx;
+        } else
+            ret = ff_thread_get_buffer(s->avctx, &frame->tf,
+                                       AV_GET_BUFFER_FLAG_REF);
         if (ret < 0)
             return NULL;
 
-        frame->rpl_buf = av_buffer_allocz(s->nb_nals * sizeof(RefPicListTab));
-        if (!frame->rpl_buf)
-            goto fail;
-
-        frame->tab_mvf_buf = av_buffer_pool_get(s->tab_mvf_pool);
-        if (!frame->tab_mvf_buf)
+        frame->meta_buf = av_buffer_pool_get(s->frame_meta_pool);
+        if (!frame->meta_buf)
             goto fail;
-        frame->tab_mvf = (MvField *)frame->tab_mvf_buf->data;
+        frame->tab_mvf       = (MvField *)frame->meta_buf->data;
+        frame->rpl           = (RefPicListTab *)(frame->meta_buf->data + s->frame_meta_rpl_offset);
+        frame->rpl_slice_idx = frame->meta_buf->data + s->frame_meta_map_offset;
+        frame->ctb_count     = s->sps->ctb_width * s->sps->ctb_height;
 
-        frame->rpl_tab_buf = av_buffer_pool_get(s->rpl_tab_pool);
-        if (!frame->rpl_tab_buf)
-            goto fail;
-        frame->rpl_tab   = (RefPicListTab **)frame->rpl_tab_buf->data;
-        frame->ctb_count = s->sps->ctb_width * s->sps->ctb_height;
-        for (j = 0; j < frame->ctb_count; j++)
-            frame->rpl_tab[j] = (RefPicListTab *)frame->rpl_buf->data;
+        /* the block may come from an older picture: point every CTB at the
+         * first slice and clear the lists of the slices this packet can hold */
+        memset(frame->rpl_slice_idx, 0, frame->ctb_count);
+        memset(frame->rpl, 0, FFMIN(s->nb_nals, MAX_SLICES_IN_FRAME) * sizeof(*frame->rpl));
 
         frame->frame->top_field_first  = s->picture_struct == AV_PICTURE_STRUCTURE_TOP_FIELD;
         frame->frame->interlaced_frame = (s->picture_struct == AV_PICTURE_STRUCTURE_TOP_FIELD) || (s->picture_struct == AV_PICTURE_STRUCTURE_BOTTOM_FIELD);
@@ -130,7 +183,7 @@ int ff_hevc_set_new_ref(HEVCContext *s, AVFrame **frame, int poc)
         }
     }
 
-    ref = alloc_frame(s);
+    ref = alloc_frame(s, NULL);
     if (!ref)
         return AVERROR(ENOMEM);
 
@@ -143,9 +196,32 @@ int ff_hevc_set_new_ref(HEVCContext *s, AVFrame **frame, int poc)
         ref->flags &= ~(HEVC_FRAME_FLAG_OUTPUT);
     ref->sequence = s->seq_decode;
     ref->window   = s->sps->output_window;
+    ref->decode_order = s->decode_order++;
     return 0;
 }
 #ifdef REF_IDX_FRAMEWORK
+#if ACTIVE_PU_UPSAMPLING
+/* quality scalability: the inter-layer reference is the base layer
+ * picture itself, only its motion field is derived */
+static HEVCFrame *alloc_il_frame(HEVCContext *s)
+{
+    HEVCFrame *bl = s->BL_frame;
+    HEVCFrame *ref;
+
+    s->bl_aliased = 0;
+    if (!ACTIVE_BOTH_FRAME_AND_PU && s->up_filter_inf.idx == SNR &&
+        bl->frame->coded_width  == s->sps->width  &&
+        bl->frame->coded_height == s->sps->height &&
+        bl->frame->format       == s->sps->pix_fmt) {
+        ref = alloc_frame(s, bl->frame);
+        if (ref)
+            s->bl_aliased = 1;
+        return ref;
+    }
+    return alloc_frame(s, NULL);
+}
+#endif
+
 int ff_hevc_set_new_iter_layer_ref(HEVCContext *s, AVFrame **frame, int poc)
 {
     HEVCFrame *ref;
@@ -162,7 +238,11 @@ int ff_hevc_set_new_iter_layer_ref(HEVCContext *s, AVFrame **frame, int poc)
         }
     }
     
-    ref = alloc_frame(s);
+#if ACTIVE_PU_UPSAMPLING
+    ref = alloc_il_frame(s);
+#else
+    ref = alloc_frame(s, NULL);
+#endif
     if (!ref)
         return AVERROR(ENOMEM);
     
@@ -179,11 +259,25 @@ int ff_hevc_set_new_iter_layer_ref(HEVCContext *s, AVFrame **frame, int poc)
     return 0;
 }
 #endif
+/* C.5.2.2: a picture which waited for SpsMaxLatencyPictures pictures
+ * has to be output */
+static int max_latency_reached(HEVCContext *s, int min_order)
+{
+    int tid = s->sps->max_sub_layers - 1;
+    int max_latency_increase = s->sps->temporal_layer[tid].max_latency_increase;
+
+    if (max_latency_increase < 0 || min_order == INT_MAX)
+        return 0;
+    return s->decode_order - 1 - min_order >=
+           s->sps->temporal_layer[tid].num_reorder_pics + max_latency_increase;
+}
+
 int ff_hevc_output_frame(HEVCContext *s, AVFrame *out, int flush)
 {
     do {
         int nb_output = 0;
         int min_poc   = INT_MAX;
+        int min_order = INT_MAX;
         int i, min_idx=0, ret;
 
         if (s->sh.no_output_of_prior_pics_flag == 1) {
@@ -205,6 +299,7 @@ int ff_hevc_output_frame(HEVCContext *s, AVFrame *out, int flush)
                     min_poc = frame->poc;
                     min_idx = i;
                 }
+                min_order = FFMIN(min_order, frame->decode_order);
             }
         }
 #if FRAME_CONCEALMENT
@@ -213,7 +308,8 @@ int ff_hevc_output_frame(HEVCContext *s, AVFrame *out, int flush)
 
         /* wait for more frames before output */
         if (!flush && s->seq_output == s->seq_decode && s->sps &&
-            nb_output <= s->sps->temporal_layer[s->sps->max_sub_layers - 1].num_reorder_pics)
+            nb_output <= s->sps->temporal_layer[s->sps->max_sub_layers - 1].num_reorder_pics &&
+            !(s->low_latency && max_latency_reached(s, min_order)))
             return 0;
 
         if (nb_output) {
@@ -313,13 +409,11 @@ static int init_slice_rpl(HEVCContext *s)
         int ctb_count    = frame->ctb_count;
         
         int ctb_addr_ts  = s->pps->ctb_addr_rs_to_ts[s->sh.slice_segment_addr];
-        int i;
-        if (s->slice_idx >= frame->rpl_buf->size / sizeof(RefPicListTab))
+        if (s->slice_idx >= MAX_SLICES_IN_FRAME)
             return AVERROR_INVALIDDATA;
 
-        for (i = ctb_addr_ts; i < ctb_count; i++)
-            frame->rpl_tab[i] = (RefPicListTab *)frame->rpl_buf->data + s->slice_idx;
-        frame->refPicList[s->slice_idx] = (RefPicList *)frame->rpl_tab[ctb_addr_ts];
+        memset(frame->rpl_slice_idx + ctb_addr_ts, s->slice_idx, ctb_count - ctb_addr_ts);
+        frame->refPicList[s->slice_idx] = frame->rpl[s->slice_idx].refPicList;
         return 0;
     }
     return AVERROR_INVALIDDATA;
@@ -330,15 +424,12 @@ static int init_il_slice_rpl(HEVCContext *s)
     HEVCFrame *frame = s->inter_layer_ref;
     int ctb_count   = frame->ctb_count;
     int ctb_addr_ts = s->pps->ctb_addr_rs_to_ts[s->sh.slice_segment_addr];
-    int i;
-    
-    if (s->slice_idx >= frame->rpl_buf->size / sizeof(RefPicListTab))
+
+    if (s->slice_idx >= MAX_SLICES_IN_FRAME)
         return AVERROR_INVALIDDATA;
-    
-    for (i = ctb_addr_ts; i < ctb_count; i++)
-        frame->rpl_tab[i] = (RefPicListTab*)frame->rpl_buf->data + s->slice_idx;
-    
-    frame->refPicList[s->slice_idx] = (RefPicList*)frame->rpl_tab[ctb_addr_ts];
+
+    memset(frame->rpl_slice_idx + ctb_addr_ts, s->slice_idx, ctb_count - ctb_addr_ts);
+    frame->refPicList[s->slice_idx] = frame->rpl[s->slice_idx].refPicList;
     
     return 0;
 }
@@ -546,7 +637,7 @@ static HEVCFrame *generate_missing_ref(HEVCContext *s, int poc)
     int x, y; 
 #endif
 
-    frame = alloc_frame(s);
+    frame = alloc_frame(s, NULL);
     if (!frame)
         return NULL;
 
@@ -569,9 +660,7 @@ static HEVCFrame *generate_missing_ref(HEVCContext *s, int poc)
                     conc_frame->frame->linesize, s->sps->pix_fmt , conc_frame->frame->width,
                     conc_frame->frame->height);
 #if COPY_MV
-    memcpy(frame->rpl_buf->data, conc_frame->rpl_buf->data, frame->rpl_buf->size);
-    memcpy(frame->tab_mvf_buf->data, conc_frame->tab_mvf_buf->data, frame->tab_mvf_buf->size);
-    memcpy(frame->rpl_tab_buf->data, conc_frame->rpl_tab_buf->data, frame->rpl_tab_buf->size);
+    memcpy(frame->meta_buf->data, conc_frame->meta_buf->data, frame->meta_buf->size);
 #endif
 #else
     if (!s->sps->pixel_shift) {
@@ -630,7 +719,7 @@ static int add_candidate_ref(HEVCContext *s, RefPicList *list,
 #ifdef REF_IDX_FRAMEWORK
 static void init_upsampled_mv_fields(HEVCContext *s) {
     HEVCFrame *refEL = s->inter_layer_ref;
-    memset(refEL->tab_mvf_buf->data, 0, refEL->tab_mvf_buf->size); // is intra = 0
+    memset(refEL->tab_mvf, 0, s->sps->min_pu_width * s->sps->min_pu_height * sizeof(MvField)); // is intra = 0
 }
 #endif
 
@@ -777,7 +866,8 @@ int ff_hevc_compute_poc(HEVCContext *s, int poc_lsb)
     // For BLA picture types, POCmsb is set to 0.
     if (s->nal_unit_type == NAL_BLA_W_LP   ||
         s->nal_unit_type == NAL_BLA_W_RADL ||
-        s->nal_unit_type == NAL_BLA_N_LP)
+        s->nal_unit_type == NAL_BLA_N_LP   ||
+        IS_CRA_AS_BLA(s))
         poc_msb = 0;
 
     return poc_msb + poc_lsb;
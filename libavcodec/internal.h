@@ -62,6 +62,12 @@ typedef struct FramePool {
     int planes;
     int channels;
     int samples;
+
+    /**
+     * Back video planes with transparent huge pages and fault them in
+     * when the buffer is created.
+     */
+    int hugepages;
 } FramePool;
 
 typedef struct AVCodecInternal {
@@ -218,6 +224,14 @@ int ff_get_buffer(AVCodecContext *avctx, AVFrame *frame, int flags);
  */
 int ff_reget_buffer(AVCodecContext *avctx, AVFrame *frame);
 
+/**
+ * Fill the default frame pool with nb_frames buffers for the current
+ * video parameters, so that later ff_get_buffer() calls do not allocate.
+ * Does nothing when a custom get_buffer2() is used or when the pool was
+ * already set up for these parameters.
+ */
+int ff_prealloc_buffers(AVCodecContext *avctx, int nb_frames);
+
 int ff_thread_can_start_frame(AVCodecContext *avctx);
 
 int avpriv_h264_has_num_reorder_frames(AVCodecContext *avctx);
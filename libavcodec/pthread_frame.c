@@ -102,6 +102,18 @@ typedef struct PerThreadContext {
     enum AVPixelFormat result_format;            ///< get_format() result
 } PerThreadContext;
 
+/**
+ * Lower layer picture handed to the upper layer decoder.
+ * Each picture has its own condition so that reporting it only wakes up
+ * the upper layer threads waiting for it.
+ */
+typedef struct ILProgress {
+    int   status;        ///< 0 unavailable, 1 reported by the lower layer, 3 released by the upper layer first
+    void *ref;
+    void *data;
+    pthread_cond_t cond;
+} ILProgress;
+
 /**
  * Context stored in the client AVCodecInternal thread_ctx_frame.
  */
@@ -118,14 +130,12 @@ typedef struct FrameThreadContext {
                                     * Set for the first N packets, where N is the number of threads.
                                     * While it is set, ff_thread_en/decode_frame won't return any results.
                                     */
+    int max_delay;                 ///< Packets in flight before the first output, may be lowered by the codec while delaying.
 
     int die;                       ///< Set when threads should exit.
-    int is_decoded[MAX_POC];
     int last_Tid;
-    void* frames_ref[MAX_POC];
-    void* frames_data[MAX_POC];
-    pthread_mutex_t il_progress_mutex; ///< Mutex used to protect frame progress values and progress_cond.
-    pthread_cond_t  il_progress_cond;   ///< Used by child threads to wait for progress to change.
+    ILProgress il_progress[MAX_POC];   ///< Lower layer pictures handed to the upper layer, by poc_id.
+    pthread_mutex_t il_progress_mutex; ///< Mutex used to protect il_progress.
 } FrameThreadContext;
 
 #if FF_API_GET_BUFFER
@@ -423,9 +433,17 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
 
     /*
      * If we're still receiving the initial packets, don't return a frame.
+     * The codec may lower the delay while setting up, so wait for it.
      */
 
-    if (fctx->next_decoding > (avctx->thread_count_frame-1-(avctx->codec_id == AV_CODEC_ID_FFV1)))
+    if (fctx->delaying && p->state == STATE_SETTING_UP) {
+        pthread_mutex_lock(&p->progress_mutex);
+        while (p->state == STATE_SETTING_UP)
+            pthread_cond_wait(&p->progress_cond, &p->progress_mutex);
+        pthread_mutex_unlock(&p->progress_mutex);
+    }
+
+    if (fctx->next_decoding > fctx->max_delay)
         fctx->delaying = 0;
 
     if (fctx->delaying) {
@@ -440,7 +458,6 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
      * didn't output a frame, because we don't want to accidentally signal
      * EOF (avpkt->size == 0 && *got_picture_ptr == 0).
      */
-    finished = fctx->next_decoding >= avctx->thread_count_frame ? 0:fctx->next_decoding;
     do {
         p = &fctx->threads[finished++];
 
@@ -467,6 +484,7 @@ int ff_thread_decode_frame(AVCodecContext *avctx,
     } while (!avpkt->size && !*got_picture_ptr && finished != fctx->next_finished);
 
     update_context_from_thread(avctx, p->avctx, 1);
+    avctx->delay = fctx->max_delay;
 
     if (fctx->next_decoding >= avctx->thread_count_frame) fctx->next_decoding = 0;
 
@@ -522,6 +540,7 @@ void ff_thread_report_il_progress(AVCodecContext *avxt, int poc, void * in_ref,
 */
     PerThreadContext *p;
     FrameThreadContext *fctx;
+    ILProgress *il;
     p = avxt->internal->thread_ctx_frame;
     fctx = p->parent;
 
@@ -529,14 +548,15 @@ void ff_thread_report_il_progress(AVCodecContext *avxt, int poc, void * in_ref,
     if (avxt->debug&FF_DEBUG_THREADS)
         av_log(avxt, AV_LOG_DEBUG, "ff_thread_report_il_progress %d\n", poc);
     pthread_mutex_lock(&fctx->il_progress_mutex);
-    if(fctx->is_decoded[poc] == 3 && in_ref) {
+    il = &fctx->il_progress[poc];
+    if(il->status == 3 && in_ref) {
         ff_hevc_unref_frame(avxt->priv_data, in_ref, ~0);
-        fctx->is_decoded[poc] = 0;
+        il->status = 0;
     } else {
-            fctx->is_decoded[poc]     = 1;
-            fctx->frames_ref[poc]     = in_ref;
-            fctx->frames_data[poc]    = in_data;
-            pthread_cond_broadcast(&fctx->il_progress_cond);
+            il->status = 1;
+            il->ref    = in_ref;
+            il->data   = in_data;
+            pthread_cond_broadcast(&il->cond);
     }
     
     pthread_mutex_unlock(&fctx->il_progress_mutex);
@@ -556,7 +576,7 @@ int ff_thread_get_il_up_status(AVCodecContext *avxt, int poc)
     if (avxt->debug&FF_DEBUG_THREADS)
         av_log(avxt, AV_LOG_DEBUG, "ff_thread_get_il_up_status %d \n", poc);
     pthread_mutex_lock(&fctx->il_progress_mutex);
-    res = fctx->is_decoded[poc];
+    res = fctx->il_progress[poc].status;
     pthread_mutex_unlock(&fctx->il_progress_mutex);
     return res;
 }
@@ -564,19 +584,21 @@ int ff_thread_get_il_up_status(AVCodecContext *avxt, int poc)
 void ff_thread_await_il_progress(AVCodecContext *avxt, int poc, void ** out) {
     /*
      - Wait untill the lower layer picture used for inter-layer reference picture is either allocated or decoded
-     - The condition is that the $is_decoded$ variable of the corresponding poc is diffetent from 0.
+     - The condition is that the status of the corresponding poc is diffetent from 0.
      - $copy_opaque$ allows to access to the $parent$ variable of the lower layer decoder.
      - Get the reference of the reference picture picture from lower layer decoder.
      
      */
     FrameThreadContext *fctx = ((AVCodecContext *)avxt->BL_avcontext)->internal->thread_ctx_frame;
+    ILProgress *il;
     poc = poc & (MAX_POC-1);
+    il  = &fctx->il_progress[poc];
     if (avxt->debug&FF_DEBUG_THREADS)
         av_log(avxt, AV_LOG_DEBUG, "ff_thread_await_il_progress %d \n", poc);
     pthread_mutex_lock(&fctx->il_progress_mutex);
-    while(fctx->is_decoded[poc] == 0)
-        pthread_cond_wait(&fctx->il_progress_cond, &fctx->il_progress_mutex);
-    *out = fctx->frames_data[poc];
+    while(il->status == 0)
+        pthread_cond_wait(&il->cond, &fctx->il_progress_mutex);
+    *out = il->data;
     pthread_mutex_unlock(&fctx->il_progress_mutex);
 }
 
@@ -586,18 +608,20 @@ void ff_thread_report_il_status(AVCodecContext *avxt, int poc, int status) {
      */
     FrameThreadContext *fctx = ((AVCodecContext *)avxt->BL_avcontext)->internal->thread_ctx_frame;
     AVCodecContext *avxt_bl = (AVCodecContext *)avxt->BL_avcontext;
+    ILProgress *il;
     poc = poc & (MAX_POC-1);
+    il  = &fctx->il_progress[poc];
     if (avxt->debug&FF_DEBUG_THREADS)
         av_log(avxt, AV_LOG_DEBUG, "ff_thread_report_il_status poc %d status %d\n", poc, status);
     pthread_mutex_lock(&fctx->il_progress_mutex);
-    if(fctx->is_decoded[poc]==1 ) {
-        if(fctx->frames_ref[poc])
-            ff_hevc_unref_frame(avxt_bl->priv_data, fctx->frames_ref[poc], ~0);
-        fctx->is_decoded[poc] = 0;
+    if(il->status == 1) {
+        if(il->ref)
+            ff_hevc_unref_frame(avxt_bl->priv_data, il->ref, ~0);
+        il->status = 0;
     } else
-        fctx->is_decoded[poc] = 3;
-    fctx->frames_data[poc] = NULL;
-    fctx->frames_ref[poc] = NULL;
+        il->status = 3;
+    il->data = NULL;
+    il->ref  = NULL;
     pthread_mutex_unlock(&fctx->il_progress_mutex);
 }
 
@@ -614,15 +638,28 @@ void ff_thread_report_il_status2(AVCodecContext *avxt, int poc, int status) {
     if (avxt->debug&FF_DEBUG_THREADS)
         av_log(avxt, AV_LOG_DEBUG, "ff_thread_report_il_status2\n");
     pthread_mutex_lock(&fctx->il_progress_mutex);
-    fctx->is_decoded[poc] = status;
+    fctx->il_progress[poc].status = status;
     if(!status) {
-        fctx->frames_data[poc] = NULL;
-                fctx->frames_ref[poc] = NULL;
+        fctx->il_progress[poc].data = NULL;
+        fctx->il_progress[poc].ref  = NULL;
     }
     pthread_mutex_unlock(&fctx->il_progress_mutex);
 }
 #endif
 
+int ff_thread_limit_delay(AVCodecContext *avctx, int delay)
+{
+    PerThreadContext *p = avctx->internal->thread_ctx_frame;
+    FrameThreadContext *fctx;
+
+    if (!(avctx->active_thread_type&FF_THREAD_FRAME)) return 0;
+
+    fctx = p->parent;
+    if (fctx->delaying && p->state == STATE_SETTING_UP)
+        fctx->max_delay = FFMAX(FFMIN(fctx->max_delay, delay), 0);
+    return fctx->max_delay;
+}
+
 void ff_thread_finish_setup(AVCodecContext *avctx) {
     PerThreadContext *p = avctx->internal->thread_ctx_frame;
 
@@ -716,6 +753,9 @@ void ff_frame_thread_free(AVCodecContext *avctx, int thread_count)
 
     av_freep(&fctx->threads);
     pthread_mutex_destroy(&fctx->buffer_mutex);
+    pthread_mutex_destroy(&fctx->il_progress_mutex);
+    for (i = 0; i < MAX_POC; i++)
+        pthread_cond_destroy(&fctx->il_progress[i].cond);
     av_freep(&avctx->internal->thread_ctx_frame);
 }
 
@@ -751,9 +791,11 @@ int ff_frame_thread_init(AVCodecContext *avctx)
 
     fctx->threads = av_mallocz(sizeof(PerThreadContext) * thread_count);
     pthread_mutex_init(&fctx->buffer_mutex, NULL);
-    pthread_cond_init(&fctx->il_progress_cond, NULL);
     pthread_mutex_init(&fctx->il_progress_mutex, NULL);
+    for (i = 0; i < MAX_POC; i++)
+        pthread_cond_init(&fctx->il_progress[i].cond, NULL);
     fctx->delaying = 1;
+    fctx->max_delay = thread_count - 1 - (avctx->codec_id == AV_CODEC_ID_FFV1);
 
     for (i = 0; i < thread_count; i++) {
         AVCodecContext *copy = av_malloc(sizeof(AVCodecContext));
@@ -845,6 +887,7 @@ void ff_thread_flush(AVCodecContext *avctx)
 
     fctx->next_decoding = fctx->next_finished = 0;
     fctx->delaying = 1;
+    fctx->max_delay = avctx->thread_count_frame - 1 - (avctx->codec_id == AV_CODEC_ID_FFV1);
     fctx->prev_thread = NULL;
     for (i = 0; i < avctx->thread_count_frame; i++) {
         PerThreadContext *p = &fctx->threads[i];
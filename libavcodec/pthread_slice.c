@@ -63,6 +63,7 @@ typedef struct SliceThreadContext {
 
     int *entries;
     int entries_count;
+    int entries_allocated;
     int thread_count;
     pthread_cond_t *progress_cond;
     pthread_mutex_t *progress_mutex;
@@ -121,6 +122,12 @@ void ff_slice_thread_free(AVCodecContext *avctx)
     pthread_cond_destroy(&c->current_job_cond);
     pthread_cond_destroy(&c->last_job_cond);
     av_free(c->workers);
+    if (c->progress_mutex && c->progress_cond) {
+        for (i = 0; i < c->thread_count; i++) {
+            pthread_mutex_destroy(&c->progress_mutex[i]);
+            pthread_cond_destroy(&c->progress_cond[i]);
+        }
+    }
     av_freep(&c->entries);
     av_freep(&c->progress_mutex);
     av_freep(&c->progress_cond);
@@ -268,23 +275,37 @@ int ff_alloc_entries(AVCodecContext *avctx, int count)
 
     if (avctx->active_thread_type & FF_THREAD_SLICE)  {
         SliceThreadContext *p = avctx->internal->thread_ctx;
-        p->thread_count  = avctx->thread_count;
-        p->entries       = av_mallocz_array(count, sizeof(int));
 
-        p->progress_mutex = av_malloc_array(p->thread_count, sizeof(pthread_mutex_t));
-        p->progress_cond  = av_malloc_array(p->thread_count, sizeof(pthread_cond_t));
-
-        if (!p->entries || !p->progress_mutex || !p->progress_cond) {
+        /* the entries and the progress locks are kept across calls, they are
+         * only reallocated when a slice needs more entries than ever before */
+        if (count > p->entries_allocated) {
             av_freep(&p->entries);
-            av_freep(&p->progress_mutex);
-            av_freep(&p->progress_cond);
-            return AVERROR(ENOMEM);
+            p->entries = av_mallocz_array(count, sizeof(int));
+            if (!p->entries) {
+                p->entries_allocated = p->entries_count = 0;
+                return AVERROR(ENOMEM);
+            }
+            p->entries_allocated = count;
+        } else {
+            memset(p->entries, 0, count * sizeof(int));
         }
-        p->entries_count  = count;
+        p->entries_count = count;
 
-        for (i = 0; i < p->thread_count; i++) {
-            pthread_mutex_init(&p->progress_mutex[i], NULL);
-            pthread_cond_init(&p->progress_cond[i], NULL);
+        if (!p->progress_mutex) {
+            p->thread_count   = avctx->thread_count;
+            p->progress_mutex = av_malloc_array(p->thread_count, sizeof(pthread_mutex_t));
+            p->progress_cond  = av_malloc_array(p->thread_count, sizeof(pthread_cond_t));
+
+            if (!p->progress_mutex || !p->progress_cond) {
+                av_freep(&p->progress_mutex);
+                av_freep(&p->progress_cond);
+                return AVERROR(ENOMEM);
+            }
+
+            for (i = 0; i < p->thread_count; i++) {
+                pthread_mutex_init(&p->progress_mutex[i], NULL);
+                pthread_cond_init(&p->progress_cond[i], NULL);
+            }
         }
     }
 
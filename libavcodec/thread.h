@@ -72,6 +72,17 @@ int ff_thread_decode_frame(AVCodecContext *avctx, AVFrame *picture,
  */
 void ff_thread_finish_setup(AVCodecContext *avctx);
 
+/**
+ * Lower the number of packets frame threading buffers before returning the
+ * first frame. Only effective before the first frame is returned and
+ * before ff_thread_finish_setup() is called.
+ *
+ * @param avctx The context.
+ * @param delay The maximum delay in packets.
+ * @return the delay in packets added by frame threading
+ */
+int ff_thread_limit_delay(AVCodecContext *avctx, int delay);
+
 /**
  * Notify later decoding threads when part of their reference picture is ready.
  * Call this when some part of the picture is finished decoding.
@@ -57,6 +57,9 @@
 #if CONFIG_ICONV
 # include <iconv.h>
 #endif
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #if HAVE_PTHREADS
 #include <pthread.h>
@@ -506,6 +509,33 @@ int avcodec_fill_audio_frame(AVFrame *frame, int nb_channels,
     return ret;
 }
 
+/* Ask for huge pages on the 2 MB aligned part of the block before the
+ * first write, the memset then faults them in here instead of during
+ * motion compensation. */
+static AVBufferRef *frame_pool_alloc_hugepages(int size)
+{
+    AVBufferRef *buf;
+    uint8_t *data = av_malloc(size);
+
+    if (!data)
+        return NULL;
+#if HAVE_SYS_MMAN_H && defined(MADV_HUGEPAGE)
+    {
+        const uintptr_t huge_size = 1 << 21;
+        uintptr_t start = FFALIGN((uintptr_t)data, huge_size);
+        uintptr_t end   = ((uintptr_t)data + size) & ~(huge_size - 1);
+        if (end > start)
+            madvise((void *)start, end - start, MADV_HUGEPAGE);
+    }
+#endif
+    memset(data, 0, size);
+
+    buf = av_buffer_create(data, size, av_buffer_default_free, NULL, 0);
+    if (!buf)
+        av_free(data);
+    return buf;
+}
+
 static int update_frame_pool(AVCodecContext *avctx, AVFrame *frame)
 {
     FramePool *pool = avctx->internal->pool;
@@ -558,6 +588,8 @@ static int update_frame_pool(AVCodecContext *avctx, AVFrame *frame)
                 pool->pools[i] = av_buffer_pool_init(size[i] + 16 + STRIDE_ALIGN - 1,
                                                      CONFIG_MEMORY_POISONING ?
                                                         NULL :
+                                                     pool->hugepages ?
+                                                        frame_pool_alloc_hugepages :
                                                         av_buffer_allocz);
                 if (!pool->pools[i]) {
                     ret = AVERROR(ENOMEM);
@@ -1053,6 +1085,43 @@ int ff_get_buffer(AVCodecContext *avctx, AVFrame *frame, int flags)
     return ret;
 }
 
+int ff_prealloc_buffers(AVCodecContext *avctx, int nb_frames)
+{
+    FramePool *pool = avctx->internal->pool;
+    AVFrame **frames;
+    int i, ret = 0;
+
+    if (avctx->codec_type != AVMEDIA_TYPE_VIDEO ||
+        avctx->get_buffer2 != avcodec_default_get_buffer2 || nb_frames <= 0)
+        return 0;
+
+    if (pool->format == avctx->pix_fmt &&
+        pool->width  == FFMAX(avctx->width,  FF_CEIL_RSHIFT(avctx->coded_width,  avctx->lowres)) &&
+        pool->height == FFMAX(avctx->height, FF_CEIL_RSHIFT(avctx->coded_height, avctx->lowres)))
+        return 0;
+
+    frames = av_mallocz_array(nb_frames, sizeof(*frames));
+    if (!frames)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < nb_frames; i++) {
+        frames[i] = av_frame_alloc();
+        if (!frames[i]) {
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        if ((ret = ff_get_buffer(avctx, frames[i], 0)) < 0)
+            break;
+    }
+
+    /* the buffers go back to the pool */
+    for (i = 0; i < nb_frames; i++)
+        av_frame_free(&frames[i]);
+    av_free(frames);
+
+    return ret;
+}
+
 static int reget_buffer_internal(AVCodecContext *avctx, AVFrame *frame)
 {
     AVFrame *tmp;
@@ -3695,6 +3764,11 @@ void ff_thread_finish_setup(AVCodecContext *avctx)
 {
 }
 
+int ff_thread_limit_delay(AVCodecContext *avctx, int delay)
+{
+    return 0;
+}
+
 void ff_thread_report_progress(ThreadFrame *f, int progress, int field)
 {
 }
@@ -51,8 +51,11 @@ void print_usage() {
     printf(usage, program);
     printf("     -a : disable AU\n");
     printf("     -c : no check md5\n");
+    printf("     -d : drop the non-reference pictures of the highest temporal layer (fast forward)\n");
+    printf("     -e : read input as raw Annex-B stream (mmap, no demuxer)\n");
     printf("     -f <thread type> (1: frame, 2: slice, 4: frameslice)\n");
     printf("     -i <input file>\n");
+    printf("     -k <mode> Decode the IRAP pictures only (1), without the loop filters (2)\n");
     printf("     -n : no display\n");
     printf("     -o <output file>\n");
     printf("     -p <number of threads> \n");
@@ -132,7 +135,7 @@ int getopt(int nargc, char * const *nargv, const char *ostr) {
 void init_main(int argc, char *argv[]) {
     // every command line option must be followed by ':' if it takes an
     // argument, and '::' if this argument is optional
-    const char *ostr = "achi:no:p:f:s:t:wl:r:";
+    const char *ostr = "acdehi:k:no:p:f:s:t:wl:r:";
 
     int c;
     check_md5_flags   = ENABLE;
@@ -146,6 +149,9 @@ void init_main(int argc, char *argv[]) {
     quality_layer_id  = 0; // Base layer
     num_frames        = 0;
     frame_rate        = 0;
+    annexb_input      = DISABLE;
+    drop_non_ref      = DISABLE;
+    irap_only         = 0;
 
     program           = argv[0];
     
@@ -156,6 +162,12 @@ void init_main(int argc, char *argv[]) {
         case 'c':
             check_md5_flags = DISABLE;
             break;
+        case 'd':
+            drop_non_ref = ENABLE;
+            break;
+        case 'e':
+            annexb_input = ENABLE;
+            break;
         case 'f':
             thread_type = atoi(optarg);
             if (thread_type!=1 && thread_type!=2 && thread_type!=4) {
@@ -166,6 +178,9 @@ void init_main(int argc, char *argv[]) {
         case 'i':
             input_file = strdup(optarg);
             break;
+        case 'k':
+            irap_only = atoi(optarg);
+            break;
         case 'n':
             display_flags = DISABLE;
             break;
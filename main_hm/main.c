@@ -9,6 +9,13 @@
 #include "getopt.h"
 #include <libavformat/avformat.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 //#define TIME2
 
@@ -69,40 +76,156 @@ typedef struct OpenHevcWrapperContext {
     AVCodecParserContext *parser;
 } OpenHevcWrapperContext;
 
-int find_start_code (unsigned char *Buf, int zeros_in_startcode)
+/* Raw Annex-B elementary stream reader. The whole file is mapped once and
+ * access units are handed to the decoder as slices of the mapping, split with
+ * the same rules as hevc_find_frame_end() in libavcodec/hevc_parser.c. */
+typedef struct AnnexBReader {
+    uint8_t *data;
+    size_t   size;
+    size_t   pos;
+    int64_t  au_count;
+    uint8_t *tail;      ///< padded copy of the last access unit
+#ifndef WIN32
+    int      fd;
+#endif
+} AnnexBReader;
+
+static int annexb_open(AnnexBReader *r, const char *filename)
 {
-    int i;
-    for (i = 0; i < zeros_in_startcode; i++)
-        if(Buf[i] != 0)
-            return 0;
-    return Buf[i];
+#ifndef WIN32
+    struct stat st;
+#else
+    FILE *f;
+    long len;
+#endif
+    memset(r, 0, sizeof(*r));
+#ifndef WIN32
+    r->fd = open(filename, O_RDONLY);
+    if (r->fd < 0)
+        return -1;
+    if (fstat(r->fd, &st) < 0 || st.st_size <= 0) {
+        close(r->fd);
+        return -1;
+    }
+    r->size = st.st_size;
+    r->data = mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, r->fd, 0);
+    if (r->data == MAP_FAILED) {
+        r->data = NULL;
+        close(r->fd);
+        return -1;
+    }
+    madvise(r->data, r->size, MADV_SEQUENTIAL);
+#else
+    f = fopen(filename, "rb");
+    if (!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (len <= 0 || !(r->data = av_malloc(len + FF_INPUT_BUFFER_PADDING_SIZE))) {
+        fclose(f);
+        return -1;
+    }
+    r->size = fread(r->data, 1, len, f);
+    memset(r->data + r->size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    fclose(f);
+#endif
+    return 0;
 }
 
-int get_next_nal(FILE* inpf, unsigned char* Buf)
+static void annexb_close(AnnexBReader *r)
 {
-    int pos = 0;
-    int StartCodeFound = 0;
-    int info2 = 0;
-    int info3 = 0;
-    while(!feof(inpf)&&(/*Buf[pos++]=*/fgetc(inpf))==0);
-
-    while (pos < 3) Buf[pos++] = fgetc (inpf);
-    while (!StartCodeFound)
-    {
-        if (feof (inpf))
-        {
-            //            return -1;
-            return pos-1;
+#ifndef WIN32
+    if (r->data) {
+        munmap(r->data, r->size);
+        close(r->fd);
+    }
+#else
+    av_freep(&r->data);
+#endif
+    av_freep(&r->tail);
+}
+
+/* NAL unit types used for access unit splitting, see enum NALUnitType */
+#define NAL_RASL_R      9
+#define NAL_BLA_W_LP   16
+#define NAL_CRA_NUT    21
+#define NAL_VPS        32
+#define NAL_AUD        35
+#define NAL_SEI_PREFIX 39
+
+/* Returns the offset of the start code opening the next access unit. */
+static size_t annexb_find_au_end(const uint8_t *buf, size_t start, size_t size)
+{
+    int frame_start_found = 0;
+    size_t i = start;
+
+    while (i + 5 < size) {
+        int nut, layer_id;
+
+        if (buf[i + 2] > 1) {
+            i += 3;
+            continue;
+        }
+        if (buf[i] || buf[i + 1] || buf[i + 2] != 1) {
+            i++;
+            continue;
         }
-        Buf[pos++] = fgetc (inpf);
-        info3 = find_start_code(&Buf[pos-4], 3);
-        if(info3 != 1)
-            info2 = find_start_code(&Buf[pos-3], 2);
-        StartCodeFound = (info2 == 1 || info3 == 1);
+
+        nut      = (buf[i + 3] >> 1) & 0x3F;
+        layer_id = ((buf[i + 3] & 0x01) << 5) + (buf[i + 4] >> 3);
+
+        // Beginning of access unit
+        if ((nut >= NAL_VPS && nut <= NAL_AUD) || nut == NAL_SEI_PREFIX ||
+            (nut >= 41 && nut <= 44) || (nut >= 48 && nut <= 55)) {
+            if (frame_start_found && !layer_id)
+                return i;
+        } else if (nut <= NAL_RASL_R ||
+                   (nut >= NAL_BLA_W_LP && nut <= NAL_CRA_NUT)) {
+            int first_slice_segment_in_pic_flag = buf[i + 5] >> 7;
+            if (first_slice_segment_in_pic_flag && !layer_id) {
+                if (!frame_start_found)
+                    frame_start_found = 1;
+                else // First slice of next frame found
+                    return i;
+            }
+        }
+        i += 3;
     }
-    fseek (inpf, - 4 + info2, SEEK_CUR);
-    return pos - 4 + info2;
+    return size;
 }
+
+static int annexb_read_au(AnnexBReader *r, AVPacket *pkt)
+{
+    size_t end;
+
+    if (r->pos >= r->size)
+        return -1;
+
+    end = annexb_find_au_end(r->data, r->pos, r->size);
+
+    av_init_packet(pkt);
+    pkt->data         = r->data + r->pos;
+    pkt->size         = end - r->pos;
+    pkt->pts          = r->au_count++;
+    pkt->stream_index = 0;
+
+#ifndef WIN32
+    /* the decoder may read up to FF_INPUT_BUFFER_PADDING_SIZE bytes past the
+     * packet, which could run off the end of the mapping */
+    if (end + FF_INPUT_BUFFER_PADDING_SIZE > r->size) {
+        av_freep(&r->tail);
+        r->tail = av_mallocz(pkt->size + FF_INPUT_BUFFER_PADDING_SIZE);
+        if (!r->tail)
+            return -1;
+        memcpy(r->tail, pkt->data, pkt->size);
+        pkt->data = r->tail;
+    }
+#endif
+    r->pos = end;
+    return 0;
+}
+
 typedef struct Info {
     int NbFrame;
     int Poc;
@@ -112,10 +235,28 @@ typedef struct Info {
     int size;
 } Info;
 
+/* write the visible rows straight from the decoded planes */
+static void write_frame(FILE *fout, const OpenHevc_FrameRef *frame)
+{
+    const OpenHevc_FrameInfo *info = &frame->frameInfo;
+    int pixel_shift = info->nBitDepth > 8;
+    int chroma_w    = info->chromat_format == YUV444 ? info->nWidth  : info->nWidth  >> 1;
+    int chroma_h    = info->chromat_format == YUV420 ? info->nHeight >> 1 : info->nHeight;
+    int y;
+
+    for (y = 0; y < info->nHeight; y++)
+        fwrite((uint8_t *) frame->pvY + y * info->nYPitch, 1, info->nWidth << pixel_shift, fout);
+    for (y = 0; y < chroma_h; y++)
+        fwrite((uint8_t *) frame->pvU + y * info->nUPitch, 1, chroma_w << pixel_shift, fout);
+    for (y = 0; y < chroma_h; y++)
+        fwrite((uint8_t *) frame->pvV + y * info->nVPitch, 1, chroma_w << pixel_shift, fout);
+}
+
 static void video_decode_example(const char *filename)
 {
     AVFormatContext *pFormatCtx=NULL;
     AVPacket        packet;
+    AnnexBReader    reader;
 #if FRAME_CONCEALMENT
     FILE *fin_loss = NULL, *fin1 = NULL;
     Info info;
@@ -138,7 +279,7 @@ static void video_decode_example(const char *filename)
     char output_file2[256];
 
     OpenHevc_Frame     openHevcFrame;
-    OpenHevc_Frame_cpy openHevcFrameCpy;
+    OpenHevc_FrameRef  openHevcFrameRef;
     OpenHevc_Handle    openHevcHandle;
 
     if (filename == NULL) {
@@ -146,13 +287,20 @@ static void video_decode_example(const char *filename)
         exit(1);
     }
 
-    openHevcHandle = libOpenHevcInit(nb_pthreads, thread_type/*, pFormatCtx*/);
+    openHevcHandle = libOpenHevcInitLayers(nb_pthreads, thread_type, quality_layer_id + 1);
     libOpenHevcSetCheckMD5(openHevcHandle, check_md5_flags);
 
     if (!openHevcHandle) {
         fprintf(stderr, "could not open OpenHevc\n");
         exit(1);
     }
+    if (annexb_input) {
+        if (annexb_open(&reader, filename) < 0) {
+            printf("%s",filename);
+            exit(1); // Couldn't open file
+        }
+        video_stream_idx = 0;
+    } else {
     av_register_all();
     pFormatCtx = avformat_alloc_context();
 
@@ -173,12 +321,12 @@ static void video_decode_example(const char *filename)
     {
         libOpenHevcCopyExtraData(openHevcHandle, pFormatCtx->streams[video_stream_idx]->codec->extradata, extra_size_alloc);
     }
+    }
 
     libOpenHevcSetDebugMode(openHevcHandle, 0);
+    libOpenHevcSetActiveDecoders(openHevcHandle, quality_layer_id);
+    libOpenHevcSetViewLayers(openHevcHandle, quality_layer_id);
     libOpenHevcStartDecoder(openHevcHandle);
-    openHevcFrameCpy.pvY = NULL;
-    openHevcFrameCpy.pvU = NULL;
-    openHevcFrameCpy.pvV = NULL;
 #if USE_SDL
     Init_Time();
     if (frame_rate > 0) {
@@ -191,8 +339,8 @@ static void video_decode_example(const char *filename)
 #endif
    
     libOpenHevcSetTemporalLayer_id(openHevcHandle, temporal_layer_id);
-    libOpenHevcSetActiveDecoders(openHevcHandle, quality_layer_id);
-    libOpenHevcSetViewLayers(openHevcHandle, quality_layer_id);
+    libOpenHevcSetDropNonRef(openHevcHandle, drop_non_ref);
+    libOpenHevcSetIrapOnly(openHevcHandle, irap_only);
 #if FRAME_CONCEALMENT
     fin_loss = fopen( "/Users/wassim/Softwares/shvc_transmission/parser/hevc_parser/BascketBall_Loss.txt", "rb");
     fin1 = fopen( "/Users/wassim/Softwares/shvc_transmission/parser/hevc_parser/BascketBall.txt", "rb");
@@ -204,7 +352,9 @@ static void video_decode_example(const char *filename)
     while(!stop) {
         if (IsCloseWindowEvent())
             break;
-        if (stop_dec == 0 && av_read_frame(pFormatCtx, &packet)<0) stop_dec = 1;
+        if (annexb_input) {
+            if (stop_dec == 0 && annexb_read_au(&reader, &packet)<0) stop_dec = 1;
+        } else if (stop_dec == 0 && av_read_frame(pFormatCtx, &packet)<0) stop_dec = 1;
 #if FRAME_CONCEALMENT
         // Get the corresponding frame in the trace
         if(is_received)
@@ -241,18 +391,6 @@ static void video_decode_example(const char *filename)
                         Init_SDL((openHevcFrame.frameInfo.nYPitch - openHevcFrame.frameInfo.nWidth)/2, openHevcFrame.frameInfo.nWidth, openHevcFrame.frameInfo.nHeight);
                     }
 #endif
-                    if (fout) {
-                        int format = openHevcFrameCpy.frameInfo.chromat_format == YUV420 ? 1 : 0;
-                        libOpenHevcGetPictureInfo(openHevcHandle, &openHevcFrameCpy.frameInfo);
-                        if(openHevcFrameCpy.pvY) {
-                            free(openHevcFrameCpy.pvY);
-                            free(openHevcFrameCpy.pvU);
-                            free(openHevcFrameCpy.pvV);
-                        }
-                        openHevcFrameCpy.pvY = calloc (openHevcFrameCpy.frameInfo.nYPitch * openHevcFrameCpy.frameInfo.nHeight, sizeof(unsigned char));
-                        openHevcFrameCpy.pvU = calloc (openHevcFrameCpy.frameInfo.nUPitch * openHevcFrameCpy.frameInfo.nHeight >> format, sizeof(unsigned char));
-                        openHevcFrameCpy.pvV = calloc (openHevcFrameCpy.frameInfo.nVPitch * openHevcFrameCpy.frameInfo.nHeight >> format, sizeof(unsigned char));
-                    }
                 }
 #if USE_SDL
                 if (frame_rate > 0) {
@@ -265,12 +403,9 @@ static void video_decode_example(const char *filename)
                             openHevcFrame.pvY, openHevcFrame.pvU, openHevcFrame.pvV);
                 }
 #endif
-                if (fout) {
-                    int format = openHevcFrameCpy.frameInfo.chromat_format == YUV420 ? 1 : 0;
-                    libOpenHevcGetOutputCpy(openHevcHandle, 1, &openHevcFrameCpy);
-                    fwrite( openHevcFrameCpy.pvY , sizeof(uint8_t) , openHevcFrameCpy.frameInfo.nYPitch * openHevcFrameCpy.frameInfo.nHeight, fout);
-                    fwrite( openHevcFrameCpy.pvU , sizeof(uint8_t) , openHevcFrameCpy.frameInfo.nUPitch * openHevcFrameCpy.frameInfo.nHeight >> format, fout);
-                    fwrite( openHevcFrameCpy.pvV , sizeof(uint8_t) , openHevcFrameCpy.frameInfo.nVPitch * openHevcFrameCpy.frameInfo.nHeight >> format, fout);
+                if (fout && libOpenHevcGetOutputRef(openHevcHandle, 1, &openHevcFrameRef) > 0) {
+                    write_frame(fout, &openHevcFrameRef);
+                    libOpenHevcReleaseFrame(&openHevcFrameRef);
                 }
                 nbFrame++;
                 if (nbFrame == num_frames)
@@ -289,15 +424,12 @@ static void video_decode_example(const char *filename)
 #endif
     CloseSDLDisplay();
 #endif
-    if (fout) {
+    if (fout)
         fclose(fout);
-        if(openHevcFrameCpy.pvY) {
-            free(openHevcFrameCpy.pvY);
-            free(openHevcFrameCpy.pvU);
-            free(openHevcFrameCpy.pvV);
-        }
-    }
-    avformat_close_input(&pFormatCtx);
+    if (annexb_input)
+        annexb_close(&reader);
+    else
+        avformat_close_input(&pFormatCtx);
     libOpenHevcClose(openHevcHandle);
 #if USE_SDL
 #ifdef TIME2